@@ -1,8 +1,12 @@
 import argparse
+import atexit
 import sys
 import os
 import math
+import re
+import fnmatch
 import m5
+from m5.util import convert
 import shlex
 
 cpu_types = {"atomic": m5.objects.AtomicSimpleCPU,
@@ -22,6 +26,9 @@ mem_types = {"GDDR5_4000_x64": m5.objects.GDDR5_4000_x64,
 	     "SimpleMemory": m5.objects.HBM_1000_4H_x64,
 	     "DDR4_2400_x64": m5.objects.DDR4_2400_x64,
 	     "WideIO_200_x128": m5.objects.WideIO_200_x128}
+prefetcher_types = {"none": None,
+                    "stride": m5.objects.StridePrefetcher,
+                    "tagged": m5.objects.TaggedPrefetcher}
 
 parser = argparse.ArgumentParser()
 parser.add_argument("command", nargs='*',
@@ -37,6 +44,10 @@ parser.add_argument("-m", "--mem-size", default="512MB",
         help="physical memory size")
 parser.add_argument("--mem-type", nargs='?', choices=sorted(mem_types.keys()), default="DDR3_1600_x64",
         metavar="MEM_TYPE", help="type of memory to use (pass no argument to list available memory types)")
+parser.add_argument("--mem-channels", type=int, default=1,
+        help="number of memory channels (at most 8), each with its own controller; addresses are interleaved across them")
+parser.add_argument("--mem-ranks", type=int, default=None,
+        help="number of ranks per memory channel")
 parser.add_argument("--fastmem", action="store_true",
         help="use fast memory model")
 parser.add_argument("--cacheline-size", type=int, default=64,
@@ -47,8 +58,28 @@ parser.add_argument("--sys-frequency", default="1GHz",
         help="system clock rate")
 parser.add_argument("--sys-voltage", default="1.0V",
         help="system voltage")
+parser.add_argument("--cpu-voltage", default="1.0V",
+        help="CPU voltage")
+parser.add_argument("--cpu-opp", nargs=2, action="append", default=None,
+        metavar=("FREQUENCY","VOLTAGE"), help="add a CPU operating point (repeat, fastest first); replaces --cpu-frequency/--cpu-voltage for the cores")
+parser.add_argument("--init-perf-level", type=int, nargs='+', default=[0],
+        metavar="LEVEL", help="initial operating point of each core (the last one given applies to the remaining cores)")
+parser.add_argument("--dvfs-schedule", default=None,
+        metavar="FILE", help="change core operating points at run time from lines of \"<tick> <core> <level>\"; with a dump period, each transition is deferred to the end of the dump interval it falls in, right after that interval's dump")
 parser.add_argument("-d", "--dump-period", type=float, default=None,
         help="stat dump period in milliseconds")
+parser.add_argument("--dump-insts", type=int, default=None,
+        metavar="INSTRUCTIONS", help="dump stats every INSTRUCTIONS committed instructions instead of periodically; a dump period then only bounds how long an interval may run")
+parser.add_argument("--dump-insts-core", type=int, default=None,
+        metavar="CORE", help="count --dump-insts instructions on one core instead of across all cores")
+parser.add_argument("--parallel", action="store_true",
+        help="give each core and its private caches its own event queue and host thread; the L2, buses and memory stay on the main queue")
+parser.add_argument("--sim-quantum", default="1us",
+        metavar="TIME", help="how far event queues may run apart before synchronizing in --parallel mode")
+parser.add_argument("--parallel-unsafe", action="store_true",
+        help="allow --parallel with non-KVM CPUs; gem5's classic memory system is not thread-safe across event queues, so results may differ from run to run")
+parser.add_argument("--stats-filter", nargs='+', default=None,
+        metavar="FILE", help="only dump the stats a McPAT template (.xml) refers to or a file lists (one name or shell pattern per line), plus the simulation totals")
 parser.add_argument("--stop-at-tick", type=int, default=2**64 - 1,
         metavar="TICK", help="stop simulation after some number of ticks, including those from a restored checkpoint")
 parser.add_argument("--caches", action="store_true",
@@ -69,6 +100,22 @@ parser.add_argument("--l2cache", nargs=2, default=None,
         metavar=("SIZE","ASSOC"), help="simulate L2 cache with the given parameters")
 parser.add_argument("--l2-extra", nargs=5, type=int, default=[20, 20, 20, 12, 8],
         metavar=("HIT_LATENCY","RESPONSE_LATENCY","MSHRS","TGTS_PER_MSHR","WRITE_BUFFERS"), help="extra parameters for L2 cache")
+parser.add_argument("--icache-prefetcher", choices=sorted(prefetcher_types.keys()), default="none",
+        help="hardware prefetcher for the instruction caches")
+parser.add_argument("--dcache-prefetcher", choices=sorted(prefetcher_types.keys()), default="none",
+        help="hardware prefetcher for the data caches")
+parser.add_argument("--l2-prefetcher", choices=sorted(prefetcher_types.keys()), default="none",
+        help="hardware prefetcher for the L2 cache (every bank gets its own)")
+parser.add_argument("--prefetch-degree", type=int, default=1,
+        help="number of prefetches each prefetcher issues per trigger")
+parser.add_argument("--prefetch-queue-size", type=int, default=32,
+        help="number of prefetches each prefetcher can hold before issuing them")
+parser.add_argument("--l2-banks", type=int, default=1,
+        help="split the L2 into this many address-interleaved banks (one per tile, at most 8)")
+parser.add_argument("--l2-topology", choices=["crossbar", "mesh-average"], default="crossbar",
+        help="how the cores reach the L2 banks; mesh-average adds to each bank a fixed latency for the average tile distance from all cores to it, the same for every requester (not a per-core NUCA mesh)")
+parser.add_argument("--l2-hop-latency", type=int, default=1,
+        metavar="CYCLES", help="latency of one hop between tiles for --l2-topology mesh-average")
 parser.add_argument("--fetch-policy", choices=["singlethread", "roundrobin", "branch", "iqcount", "lsqcount"], default="roundrobin", type=str.lower,
         help="SMT thread-fetching policy")
 parser.add_argument("-F", "--fast-forward", type=int, default=None,
@@ -79,6 +126,12 @@ parser.add_argument("--max-instructions", type=int, default=None,
         help="simulate some instructions and then exit.  When used with fast-forward, only instructions simulated by the second CPU model will count")
 parser.add_argument("--fast-cpu", choices=sorted(cpu_types.keys()), default="atomic",
         help="CPU type to use for fast-forward mode")
+parser.add_argument("--sample", nargs=3, type=int, default=None,
+        metavar=("PERIOD","WARMUP","DETAIL"), help="SMARTS-style sampling: every PERIOD instructions, functionally warm caches with --fast-cpu, then run WARMUP instructions of detailed warming and measure DETAIL instructions on --cpu-type, dumping stats once per sample")
+parser.add_argument("--etrace-record", nargs='?', const="etrace", default=None,
+        metavar="NAME", help="record an elastic trace of each detailed core's fetch and data dependency stream to m5out/NAME_cpuN.{inst,data}.pb.gz")
+parser.add_argument("--etrace-replay", default=None,
+        metavar="PREFIX", help="replay the elastic traces PREFIX_cpuN.{inst,data}.pb.gz on trace CPUs instead of running a workload")
 parser.add_argument("--simpoint-interval", type=int, default=None,
         metavar="INSTRUCTIONS", help="set instruction interval for simpoint analysis, and enable basic block vector generation if --run-simpoint is not present")
 parser.add_argument("--run-simpoint", nargs=3,
@@ -109,14 +162,43 @@ if args.config_from_file == None:
     print("\tL2_CAPACITY_IN_KB=<N>")
     print("\tL2_WAYS=<N>")
     print("\tINORDER=<true/false>")
+    print("\tL1I_PREFETCHER=<" + "/".join(sorted(prefetcher_types.keys())) + ">")
+    print("\tL1D_PREFETCHER=<" + "/".join(sorted(prefetcher_types.keys())) + ">")
+    print("\tL2_PREFETCHER=<" + "/".join(sorted(prefetcher_types.keys())) + ">")
+    print("\tPREFETCH_DEGREE=<N>")
+    print("\tPREFETCH_QUEUE_SIZE=<N>")
+    print("\tXLEN=<32/64>")
+    print("\tFAST_MUL_DIV=<true/false>")
+    print("\tUSE_FPU=<true/false>")
+    print("\tFDIV_SQRT=<true/false>")
+    print("\tFAST_LW=<true/false>")
+    print("\tFAST_LB=<true/false>")
+    print("\tUSE_ATOMICS=<true/false>")
     sys.exit(0)
 
-if not args.command:
+if not args.command and not args.etrace_replay:
     print("No workload specified!")
     sys.exit(1)
+if args.etrace_replay:
+    if args.command:
+        print("warning: replaying a trace.  Ignoring the workload.")
+        args.command = []
+    if args.fast_forward or args.sample or args.run_simpoint or args.simpoint_interval or args.etrace_record:
+        print("Trace replay is not compatible with fast-forwarding, sampling, simpoints or trace recording")
+        sys.exit(1)
+    if args.num_threads > 1:
+        print("Trace replay is not compatible with SMT")
+        sys.exit(1)
+if args.etrace_record:
+    if cpu_types[args.cpu_type] != cpu_types["detailed"] or args.fast_forward or args.sample:
+        print("Elastic traces can only be recorded from the detailed CPU without CPU switching")
+        sys.exit(1)
 
 fw = 8
 rw = 8
+# Rocket core options that shape the functional units; None leaves the CPU model's default pool alone
+rocket = {"XLEN": None, "FAST_MUL_DIV": None, "USE_FPU": None, "FDIV_SQRT": None,
+          "FAST_LW": None, "FAST_LB": None, "USE_ATOMICS": None}
 if args.config_from_file:
     with open(args.config_from_file, 'r') as config:
         for line in config:
@@ -168,15 +250,115 @@ if args.config_from_file:
                         args.l2cache = ["2048kB", value]
                 elif key == "INORDER":
                     args.inorder = value == "true"
+                elif key in ("L1I_PREFETCHER", "L1D_PREFETCHER", "L2_PREFETCHER"):
+                    if value not in prefetcher_types:
+                        print("Unknown prefetcher %s for %s" % (value, key))
+                        sys.exit(1)
+                    setattr(args, {"L1I_PREFETCHER": "icache_prefetcher", "L1D_PREFETCHER": "dcache_prefetcher", "L2_PREFETCHER": "l2_prefetcher"}[key], value)
+                elif key == "PREFETCH_DEGREE":
+                    args.prefetch_degree = int(value)
+                elif key == "PREFETCH_QUEUE_SIZE":
+                    args.prefetch_queue_size = int(value)
+                elif key == "XLEN":
+                    rocket[key] = int(value)
+                elif key in rocket:
+                    rocket[key] = value == "true"
         args.dcache[0] = str(args.cacheline_size*int(args.dcache[0])*int(args.dcache[1])) + "B"
         args.icache[0] = str(args.cacheline_size*int(args.icache[0])*int(args.icache[1])) + "B"
 
+if args.mem_channels < 1 or args.mem_channels & (args.mem_channels - 1):
+    print("Number of memory channels must be a power of two")
+    sys.exit(1)
+if args.mem_channels > 8:
+    # Beyond that gem5 names the controllers mem_ctrls00.., which the Penryn.xml sums (mem_ctrls0..7) would miss
+    print("At most 8 memory channels are supported by the McPAT template")
+    sys.exit(1)
+if args.mem_ranks is not None and args.mem_ranks < 1:
+    print("Number of ranks per memory channel must be positive")
+    sys.exit(1)
+
+if (args.icache_prefetcher != "none" or args.dcache_prefetcher != "none") and not args.caches:
+    print("Prefetchers require caches. Using default data and instruction cache parameters.")
+    args.caches = True
+if args.l2_prefetcher != "none" and not args.l2cache:
+    print("L2 prefetcher requires an L2 cache")
+    sys.exit(1)
+if args.l2_banks < 1 or args.l2_banks & (args.l2_banks - 1):
+    print("Number of L2 banks must be a power of two")
+    sys.exit(1)
+if args.l2_banks > 8:
+    # Beyond that gem5 names banks l200.., which the Penryn.xml L2 sums (l2, l20..l27) would miss
+    print("At most 8 L2 banks are supported by the McPAT template")
+    sys.exit(1)
+if args.l2_banks > 1 and not args.l2cache:
+    print("L2 banks require an L2 cache. Using the default L2 cache parameters.")
+    args.l2cache = ["2048kB", "8"]
+
 if cpu_types[args.cpu_type] == cpu_types["detailed"] and not args.caches:
     print("Detailed CPU model requires caches. Using default data and instruction cache parameters.")
     args.caches = True
 if args.inorder and not cpu_types[args.cpu_type] == cpu_types["detailed"]:
     print(args.cpu_type + " CPU is already inorder.")
 
+if args.parallel and args.num_cpus == 1:
+    print("warning: --parallel needs more than one core.  Running on one event queue.")
+    args.parallel = False
+if args.parallel:
+    # gem5 only supports cores on separate event queues with KVM; simple and O3 cores race with the
+    # shared buses and caches still on queue 0
+    kvm = getattr(m5.objects, "BaseKvmCPU", None)
+    models = [cpu_types[args.cpu_type]] + ([cpu_types[args.fast_cpu]] if args.fast_forward or args.sample else [])
+    if not (kvm and all(issubclass(model, kvm) for model in models)):
+        if not args.parallel_unsafe:
+            print("--parallel is only safe with KVM CPUs; the classic memory system is not thread-safe across event queues.  Use --parallel-unsafe to run it anyway")
+            sys.exit(1)
+        print("warning: running non-KVM CPUs on parallel event queues.  Memory system accesses race between host threads.")
+
+if args.dump_insts is not None:
+    if args.dump_insts < 1:
+        print("Instructions per dump must be positive")
+        sys.exit(1)
+    if args.sample:
+        print("Sampling already dumps stats once per sample")
+        sys.exit(1)
+    if args.dump_insts_core is not None and not 0 <= args.dump_insts_core < args.num_cpus:
+        print("Dump core must be between 0 and %i" % (args.num_cpus - 1))
+        sys.exit(1)
+
+if args.sample:
+    if args.fast_forward or args.run_simpoint:
+        print("Sampling is not compatible with fast-forwarding or simpoints")
+        sys.exit(1)
+    if args.sample[1] + args.sample[2] >= args.sample[0]:
+        print("Sample period must be longer than the detailed warmup and measurement")
+        sys.exit(1)
+    if args.dump_period:
+        print("warning: sampling dumps stats once per sample.  Ignoring dump period.")
+        args.dump_period = None
+    if not args.caches:
+        print("Functional warming requires caches. Using default data and instruction cache parameters.")
+        args.caches = True
+
+opps = args.cpu_opp or [[args.cpu_frequency, args.cpu_voltage]]
+init_levels = [args.init_perf_level[min(i, len(args.init_perf_level) - 1)] for i in xrange(args.num_cpus)]
+if any(level < 0 or level >= len(opps) for level in init_levels):
+    print("Initial performance levels must be between 0 and %i" % (len(opps) - 1))
+    sys.exit(1)
+dvfs_schedule = []
+if args.dvfs_schedule:
+    if args.sample:
+        print("DVFS schedules are not compatible with sampling")
+        sys.exit(1)
+    with open(args.dvfs_schedule, 'r') as schedule:
+        for line in schedule:
+            if line.strip() and line.strip()[0] != '#':
+                (tick, core, level) = (int(s) for s in line.split())
+                if core < 0 or core >= args.num_cpus or level < 0 or level >= len(opps):
+                    print("Bad DVFS schedule entry: " + line.strip())
+                    sys.exit(1)
+                dvfs_schedule.append((tick, core, level))
+    dvfs_schedule.sort()
+
 if args.run_simpoint:
     if not args.simpoint_interval:
         print("No simpoint interval specified!")
@@ -261,6 +443,44 @@ if args.inorder:
     cpu_types["detailed"].squashWidth = 1
     cpu_types["detailed"].numRobs = 1
     cpu_types["detailed"].numROBEntries = 1
+if any(v is not None for v in rocket.values()):
+    # Rocket's functional units: one ALU, an iterative multiplier/divider (multiplies unrolled
+    # 8x with FAST_MUL_DIV), a pipelined FMA unit, an iterative radix-2 divide/sqrt unit and
+    # one memory port whose loads take an extra cycle without FAST_LW.  gem5 op classes don't
+    # separate sub-word loads, so FAST_LB has no effect.
+    xlen = rocket["XLEN"] or 64
+    if xlen != 64:
+        print("warning: gem5 only simulates RV64; XLEN=%i only scales multiply and divide latency" % xlen)
+    if rocket["USE_ATOMICS"] == False:
+        print("warning: gem5 always decodes the A extension; USE_ATOMICS=false workloads must not use it")
+    if rocket["USE_FPU"] == False:
+        print("warning: no FPU; the workload must be built for soft float")
+    elif rocket["FDIV_SQRT"] == False:
+        print("warning: no FP divide/sqrt unit; the workload must be built to avoid those instructions")
+    load_lat = 2 if rocket["FAST_LW"] == False else 1
+    units = [[("IntAlu", 1, True)],
+             [("IntMult", xlen//(1 if rocket["FAST_MUL_DIV"] == False else 8) + 1, False), ("IntDiv", xlen + 1, False)],
+             [("MemRead", load_lat, True), ("FloatMemRead", load_lat, True), ("MemWrite", 1, True), ("FloatMemWrite", 1, True)],
+             [("IprAccess", 3, False)]]
+    if rocket["USE_FPU"] != False:
+        units.append([(op, 4, True) for op in ("FloatAdd", "FloatMult", "FloatMultAcc")] +
+                     [(op, 2, True) for op in ("FloatCmp", "FloatCvt", "FloatMisc")])
+        if rocket["FDIV_SQRT"] != False:
+            units.append([("FloatDiv", 56, False), ("FloatSqrt", 56, False)])
+    # Older gem5 builds lack some op classes
+    units = [[op for op in unit if op[0] in m5.objects.OpClass.vals] for unit in units]
+    cpu_types["detailed"].fuPool = m5.objects.FUPool(FUList=[m5.objects.FUDesc(count=1,
+            opList=[m5.objects.OpDesc(opClass=op, opLat=lat, pipelined=pipelined) for (op, lat, pipelined) in unit]) for unit in units])
+    # A Minor FU has one latency, so each distinct latency within a unit becomes its own FU
+    cpu_types["minor"].executeFuncUnits = m5.objects.MinorFUPool(funcUnits=[m5.objects.MinorFU(
+            opClasses=m5.objects.minorMakeOpClassSet([op for (op, l, p) in unit if (l, p) == timing]),
+            opLat=timing[0], issueLat=1 if timing[1] else timing[0])
+            for unit in units for timing in sorted(set((l, p) for (op, l, p) in unit))])
+if args.config_from_file:
+    cpu_types["minor"].decodeInputWidth = fw
+    cpu_types["minor"].executeInputWidth = fw
+    cpu_types["minor"].executeIssueLimit = fw
+    cpu_types["minor"].executeCommitLimit = rw
 if args.num_threads > 1:
     cpu_types["detailed"].numPhysIntRegs *= args.num_threads
     cpu_types["detailed"].numPhysFloatRegs *= args.num_threads
@@ -268,7 +488,20 @@ if args.num_threads > 1:
     cpu_types["detailed"].numROBEntries *= args.num_threads
     cpu_types["detailed"].smtFetchPolicy = args.fetch_policy
 
-cpu_type = cpu_types[args.fast_cpu if args.fast_forward else args.cpu_type]
+if args.etrace_record:
+    # Make the ROB and load/store queues big enough that their stalls don't end up in the trace
+    # as compute delay; replay models the real sizes
+    cpu_types["detailed"].numROBEntries = 512
+    cpu_types["detailed"].LQEntries = 128
+    cpu_types["detailed"].SQEntries = 128
+if args.etrace_replay:
+    cpu_types["replay"] = m5.objects.TraceCPU
+    cpu_types["replay"].sizeROB = cpu_types["detailed"].numROBEntries
+    cpu_types["replay"].sizeLoadBuffer = cpu_types["detailed"].LQEntries
+    cpu_types["replay"].sizeStoreBuffer = cpu_types["detailed"].SQEntries
+    args.cpu_type = "replay"
+
+cpu_type = cpu_types[args.fast_cpu if args.fast_forward or args.sample else args.cpu_type]
 if cpu_type != m5.objects.AtomicSimpleCPU:
     if args.fastmem:
         print("warning: fastmem is only compatible with the atomic CPU model.  Disabling fastmem.")
@@ -287,16 +520,28 @@ if args.num_threads > 1:
 
 system.voltage_domain = m5.objects.VoltageDomain(voltage=args.sys_voltage)
 system.clk_domain = m5.objects.SrcClockDomain(clock=args.sys_frequency, voltage_domain=system.voltage_domain)
-system.cpu_voltage_domain = m5.objects.VoltageDomain()
-system.cpu_clk_domain = m5.objects.SrcClockDomain(clock=args.cpu_frequency, voltage_domain=system.cpu_voltage_domain)
+# One clock/voltage domain pair per core, each with the full operating point table
+system.cpu_voltage_domain = [m5.objects.VoltageDomain(voltage=[v for (f, v) in opps]) for i in xrange(args.num_cpus)]
+system.cpu_clk_domain = [m5.objects.SrcClockDomain(clock=[f for (f, v) in opps], voltage_domain=system.cpu_voltage_domain[i],
+        domain_id=i, init_perf_level=init_levels[i]) for i in xrange(args.num_cpus)]
+system.l2_voltage_domain = m5.objects.VoltageDomain(voltage=opps[0][1])
+system.l2_clk_domain = m5.objects.SrcClockDomain(clock=opps[0][0], voltage_domain=system.l2_voltage_domain)
+if len(opps) > 1:
+    system.dvfs_handler.domains = system.cpu_clk_domain
+    system.dvfs_handler.enable = True
 
-if args.num_cpus > 1:
+if args.etrace_replay:
+    for i in xrange(len(system.cpu)):
+        system.cpu[i].clk_domain = system.cpu_clk_domain[i]
+        system.cpu[i].instTraceFile = "%s_cpu%i.inst.pb.gz" % (args.etrace_replay, i)
+        system.cpu[i].dataTraceFile = "%s_cpu%i.data.pb.gz" % (args.etrace_replay, i)
+elif args.num_cpus > 1:
     for i in xrange(len(system.cpu)):
-        system.cpu[i].clk_domain = system.cpu_clk_domain
+        system.cpu[i].clk_domain = system.cpu_clk_domain[i]
         system.cpu[i].workload = process[i % len(process)]
         system.cpu[i].createThreads()
 elif args.num_threads > 1:
-    system.cpu[0].clk_domain = system.cpu_clk_domain
+    system.cpu[0].clk_domain = system.cpu_clk_domain[0]
     system.cpu[0].workload = process[0]
     if len(process) > 1:
         system.cpu[0].workload = process
@@ -304,7 +549,7 @@ elif args.num_threads > 1:
         system.cpu[0].workload = process*args.num_threads;
     system.cpu[0].createThreads()
 else:
-    system.cpu[0].clk_domain = system.cpu_clk_domain
+    system.cpu[0].clk_domain = system.cpu_clk_domain[0]
     system.cpu[0].workload = process[0]
     system.cpu[0].createThreads()
 
@@ -312,11 +557,28 @@ system.membus = m5.objects.SystemXBar()
 system.system_port = system.membus.slave
 system.cache_line_size = args.cacheline_size
 if args.l2cache:
-    system.l2 = m5.objects.Cache(clk_domain=system.cpu_clk_domain, size=args.l2cache[0], assoc=int(args.l2cache[1]),
-            hit_latency=args.l2_extra[0], response_latency=args.l2_extra[1], mshrs=args.l2_extra[2], tgts_per_mshr=args.l2_extra[3], write_buffers=args.l2_extra[4])
-    system.tol2bus = m5.objects.L2XBar(clk_domain=system.cpu_clk_domain)
-    system.l2.cpu_side = system.tol2bus.master
-    system.l2.mem_side = system.membus.slave
+    # Tiles sit on a near-square grid; core i and bank i share tile i
+    tiles = max(args.num_cpus, args.l2_banks)
+    width = int(math.ceil(math.sqrt(tiles)))
+    bank_bits = int(math.log(args.l2_banks, 2))
+    line_bits = int(math.log(system.cache_line_size.value, 2))
+    l2 = []
+    for b in xrange(args.l2_banks):
+        hops = 0
+        if args.l2_topology == "mesh-average":
+            # A bridge can't carry snoops, so per-core path latencies would break L1 coherence; each bank
+            # instead gets the cores' average Manhattan distance to it
+            hops = int(round(sum(abs(c%width - b%width) + abs(c//width - b//width) for c in xrange(args.num_cpus))*args.l2_hop_latency/float(args.num_cpus)))
+        l2.append(m5.objects.Cache(clk_domain=system.l2_clk_domain, size=str(convert.toMemorySize(args.l2cache[0])//args.l2_banks) + "B", assoc=int(args.l2cache[1]),
+                hit_latency=args.l2_extra[0] + 2*hops, response_latency=args.l2_extra[1] + hops, mshrs=args.l2_extra[2], tgts_per_mshr=args.l2_extra[3], write_buffers=args.l2_extra[4],
+                addr_ranges=[m5.objects.AddrRange(r.start, size=r.size(), intlvHighBit=line_bits + bank_bits - 1, intlvBits=bank_bits, intlvMatch=b) for r in system.mem_ranges]))
+    system.l2 = l2
+    system.tol2bus = m5.objects.L2XBar(clk_domain=system.l2_clk_domain)
+    for bank in system.l2:
+        if prefetcher_types[args.l2_prefetcher]:
+            bank.prefetcher = prefetcher_types[args.l2_prefetcher](degree=args.prefetch_degree, queue_size=args.prefetch_queue_size)
+        bank.cpu_side = system.tol2bus.master
+        bank.mem_side = system.membus.slave
 for cpu in system.cpu:
     if args.fastmem:
         cpu.fastmem = True
@@ -324,6 +586,10 @@ for cpu in system.cpu:
         cpu.addSimPointProbe(args.simpoint_interval)
     if args.max_instructions and not args.fast_forward:
         cpu.max_insts_all_threads = args.max_instructions
+    if args.etrace_record:
+        i = system.cpu.index(cpu)
+        cpu.traceListener = m5.objects.ElasticTrace(instFetchTraceFile="%s_cpu%i.inst.pb.gz" % (args.etrace_record, i),
+                dataDepTraceFile="%s_cpu%i.data.pb.gz" % (args.etrace_record, i), depWindowSize=3*512)
 
     if args.caches:
         icache = m5.objects.Cache(size=args.icache[0], assoc=int(args.icache[1]),
@@ -331,6 +597,10 @@ for cpu in system.cpu:
                 is_read_only=True, writeback_clean=True)
         dcache = m5.objects.Cache(size=args.dcache[0], assoc=int(args.dcache[1]),
                 hit_latency=args.dcache_extra[0], response_latency=args.dcache_extra[1], mshrs=args.dcache_extra[2], tgts_per_mshr=args.dcache_extra[3])
+        if prefetcher_types[args.icache_prefetcher]:
+            icache.prefetcher = prefetcher_types[args.icache_prefetcher](degree=args.prefetch_degree, queue_size=args.prefetch_queue_size)
+        if prefetcher_types[args.dcache_prefetcher]:
+            dcache.prefetcher = prefetcher_types[args.dcache_prefetcher](degree=args.prefetch_degree, queue_size=args.prefetch_queue_size)
         cpu.addPrivateSplitL1Caches(icache, dcache)
     cpu.createInterruptController()
     if args.l2cache:
@@ -338,38 +608,205 @@ for cpu in system.cpu:
     else:
         cpu.connectAllPorts(system.membus)
 mem_ctrls = []
+intlv_bits = int(math.log(args.mem_channels, 2))
 for r in system.mem_ranges:
-    intlv_low_bit = math.log(max(128, system.cache_line_size.value), 2)
-    mem_ctrls.append(mem_types[args.mem_type]())
-    if issubclass(mem_types[args.mem_type], m5.objects.DRAMCtrl):
-        mem_ctrls[-1].channels = 1
-        if mem_ctrls[-1].addr_mapping.value == "RoRaBaChCo":
-            intlv_low_bit = int(math.log(mem_ctrls[-1].device_rowbuffer_size.value*mem_ctrls[-1].devices_per_rank.value, 2))
-    mem_ctrls[-1].range = m5.objects.AddrRange(r.start, size=r.size(), intlvHighBit=intlv_low_bit - 1, xorHighBit=19, intlvBits=0, intlvMatch=1)
+    for i in xrange(args.mem_channels):
+        intlv_low_bit = int(math.log(max(128, system.cache_line_size.value), 2))
+        mem_ctrls.append(mem_types[args.mem_type]())
+        if issubclass(mem_types[args.mem_type], m5.objects.DRAMCtrl):
+            mem_ctrls[-1].channels = args.mem_channels
+            if args.mem_ranks:
+                mem_ctrls[-1].ranks_per_channel = args.mem_ranks
+            if mem_ctrls[-1].addr_mapping.value == "RoRaBaChCo":
+                intlv_low_bit = int(math.log(mem_ctrls[-1].device_rowbuffer_size.value*mem_ctrls[-1].devices_per_rank.value, 2))
+        # Channel bits sit just above the interleaving granule, XORed with bits 20 and up
+        mem_ctrls[-1].range = m5.objects.AddrRange(r.start, size=r.size(), intlvHighBit=intlv_low_bit + intlv_bits - 1,
+                xorHighBit=20 + intlv_bits - 1 if intlv_bits else 0, intlvBits=intlv_bits, intlvMatch=i)
 system.mem_ctrls = mem_ctrls
 for ctrl in system.mem_ctrls:
     ctrl.port = system.membus.master
 
-if args.dump_period:
+if args.dump_period and not args.dump_insts and not (args.run_simpoint and args.fast_forward):
     m5.internal.stats.periodicStatDump(int(args.dump_period*1e9))
 root = m5.objects.Root(full_system=False, system=system)
+if args.parallel:
+    # Queue 0 keeps everything shared; a core's caches, TLBs and interrupt controller inherit its index
+    for i in xrange(args.num_cpus):
+        system.cpu[i].eventq_index = i + 1
+    root.sim_quantum = int(round(convert.toLatency(args.sim_quantum)*1e12))
 
-if args.fast_forward:
+if args.fast_forward or args.sample:
     cpu_types[args.cpu_type].numThreads = args.num_threads
     system.switch_cpus = [cpu_types[args.cpu_type](switched_out=True, cpu_id=i) for i in xrange(args.num_cpus)]
     for i in xrange(args.num_cpus):
-        system.cpu[i].max_insts_any_thread = args.fast_forward
+        if args.fast_forward:
+            system.cpu[i].max_insts_any_thread = args.fast_forward
         system.switch_cpus[i].system = system
         system.switch_cpus[i].workload = system.cpu[i].workload
         system.switch_cpus[i].clk_domain = system.cpu[i].clk_domain
+        system.switch_cpus[i].eventq_index = system.cpu[i].eventq_index
         system.switch_cpus[i].progress_interval = system.cpu[i].progress_interval
         system.switch_cpus[i].createThreads()
         if args.max_instructions:
             system.switch_cpus[i].max_insts_all_threads = args.max_instructions
 
+# With instruction-aligned dumps and sampling, each dump's interval is described in intervals.txt
+# (start/end tick and committed instructions, in total and per core) for downstream rate conversion
+intervals = None
+if args.dump_insts or args.sample:
+    intervals = open(os.path.join(m5.options.outdir, "intervals.txt"), "w")
+    intervals.write("# interval start_tick end_tick insts cause" + "".join(" cpu%i" % i for i in xrange(args.num_cpus)) + "\n")
+interval = [0, 0, [0]*args.num_cpus]
+
+def SkipExitDump():
+    # gem5 registers stats.dump to run at exit; drop it when the last interval has already been dumped
+    if hasattr(atexit, "unregister"):
+        atexit.unregister(m5.stats.dump)
+    else:
+        atexit._exithandlers[:] = [h for h in atexit._exithandlers if h[0] != m5.stats.dump]
+
+def InstCounts(cpus):
+    if not intervals:
+        return [0]*len(cpus)
+    return [sum(cpu.getCurrentInstCount(t) for t in xrange(args.num_threads)) for cpu in cpus]
+
+def StartInterval(cpus):
+    interval[1:] = [m5.curTick(), InstCounts(cpus)]
+
+def EndInterval(cpus, cause, dump=True):
+    # Dump and reset the stats for the interval that started at the last StartInterval
+    counts = InstCounts(cpus)
+    if dump:
+        m5.stats.dump()
+        m5.stats.reset()
+    if intervals:
+        insts = [c - s for (c, s) in zip(counts, interval[2])]
+        intervals.write("%i %i %i %i %s %s\n" % (interval[0], interval[1], m5.curTick(), sum(insts), cause.replace(" ", "_"), " ".join(str(i) for i in insts)))
+        intervals.flush()
+    interval[0] += 1
+    StartInterval(cpus)
+
 m5.instantiate(None)
+if args.stats_filter:
+    # Trim the registered stats down to what the power model reads, so each dump formats and writes
+    # a few hundred lines instead of thousands.  Vector and formula subnames (::total) share their
+    # stat's base name.
+    keep = set(["sim_seconds", "sim_ticks", "sim_insts", "sim_ops", "final_tick"])
+    patterns = []
+    for filename in args.stats_filter:
+        with open(filename, 'r') as f:
+            if filename.endswith(".xml"):
+                keep.update(name.split("::")[0] for name in re.findall(r"stats\.([\w.:]+)", f.read()))
+            else:
+                for line in f:
+                    if line.strip() and line.strip()[0] != '#':
+                        name = line.strip().split("::")[0]
+                        if any(c in name for c in "*?["):
+                            patterns.append(name)
+                        else:
+                            keep.add(name)
+    if not hasattr(m5.stats, "stats_list"):
+        print("warning: this gem5 build does not expose its stats list.  Ignoring stats filter.")
+    else:
+        m5.stats.stats_list[:] = [stat for stat in m5.stats.stats_list
+                                  if stat.name in keep or any(fnmatch.fnmatchcase(stat.name, p) for p in patterns)]
+        print("Dumping %i stats" % len(m5.stats.stats_list))
+if dvfs_schedule and not hasattr(system.cpu_clk_domain[0].getCCObject(), "perfLevel"):
+    # Check before simulating rather than at the first transition
+    print("This gem5 build does not export SrcClockDomain.perfLevel to Python; cannot apply the DVFS schedule")
+    sys.exit(1)
 if args.fast_forward:
     exit_event = m5.simulate(args.stop_at_tick)
     m5.switchCpus(system, [(system.cpu[i], system.switch_cpus[i]) for i in xrange(args.num_cpus)])
-exit_event = m5.simulate(args.stop_at_tick - m5.curTick())
+    if args.run_simpoint:
+        # Only the simpoint itself should show up in the stats (and in the power/thermal pipeline)
+        m5.stats.reset()
+        if args.dump_period and not args.dump_insts:
+            m5.internal.stats.periodicStatDump(int(args.dump_period*1e9))
+if args.sample:
+    # Sample boundaries follow the first core's instruction count
+    (period, warmup, detail) = args.sample
+    fast_to_detailed = [(system.cpu[i], system.switch_cpus[i]) for i in xrange(args.num_cpus)]
+    detailed_to_fast = [(system.switch_cpus[i], system.cpu[i]) for i in xrange(args.num_cpus)]
+    sample = 0
+    measured = False
+    while True:
+        system.cpu[0].scheduleInstStop(0, period - warmup - detail, "functional warming done")
+        exit_event = m5.simulate(args.stop_at_tick - m5.curTick())
+        if exit_event.getCause() != "functional warming done":
+            break
+        m5.switchCpus(system, fast_to_detailed)
+        if warmup:
+            system.switch_cpus[0].scheduleInstStop(0, warmup, "detailed warming done")
+            exit_event = m5.simulate(args.stop_at_tick - m5.curTick())
+            if exit_event.getCause() != "detailed warming done":
+                break
+        m5.stats.reset()
+        StartInterval(system.switch_cpus)
+        system.switch_cpus[0].scheduleInstStop(0, detail, "sample done")
+        exit_event = m5.simulate(args.stop_at_tick - m5.curTick())
+        if exit_event.getCause() != "sample done":
+            # The workload ended inside a measurement window; the exit dump holds that partial sample
+            EndInterval(system.switch_cpus, exit_event.getCause(), dump=False)
+            measured = True
+            break
+        print("Sample %i: ticks %i-%i" % (sample, interval[1], m5.curTick()))
+        EndInterval(system.switch_cpus, "sample")
+        sample += 1
+        m5.switchCpus(system, detailed_to_fast)
+    # Ending while warming means every sample is already dumped, and gem5's exit dump would only add
+    # a warming-only row to the power trace
+    if not measured:
+        SkipExitDump()
+else:
+    # Run to the end, stopping for DVFS transitions and --dump-insts boundaries.  With periodic dumps,
+    # a transition waits for the dump boundary it falls in so each interval (and its domain clock/voltage
+    # stats) has one operating point; otherwise every transition ends an interval.  A simulate() that
+    # stops on a boundary returns after that tick's periodic dump (Stat_Event_Pri runs before
+    # Sim_Exit_Pri), so the change still applies to the whole of the next interval.
+    period = int(args.dump_period*1e9) if args.dump_period else 0
+    cpus = system.switch_cpus if args.fast_forward else system.cpu
+    counted = [args.dump_insts_core] if args.dump_insts_core is not None else range(args.num_cpus)
+    # Periodic dumps count from where they were (re)started
+    base = m5.curTick() if args.run_simpoint and args.fast_forward else 0
+    pending = [(base + -(-max(tick - base, 0)//period)*period if period and not args.dump_insts else tick, core, level, tick)
+               for (tick, core, level) in dvfs_schedule]
+    for (tick, core, level, requested) in pending:
+        if tick != requested:
+            print("warning: DVFS transition of core %i at tick %i moved to the dump boundary at tick %i" % (core, requested, tick))
+    StartInterval(cpus)
+    if args.dump_insts:
+        for i in counted:
+            cpus[i].scheduleInstStop(0, -(-args.dump_insts//len(counted)), "dump insts %i" % i)
+    while True:
+        while pending and pending[0][0] <= m5.curTick():
+            (tick, core, level, requested) = pending.pop(0)
+            if (args.dump_insts or not period) and m5.curTick() > interval[1]:
+                EndInterval(cpus, "dvfs")
+            system.cpu_clk_domain[core].getCCObject().perfLevel(level)
+            print("DVFS: core %i to level %i (%s, %s) at tick %i (requested %i)" % (core, level, opps[level][0], opps[level][1], m5.curTick(), requested))
+        limit = args.stop_at_tick
+        if pending:
+            limit = min(limit, pending[0][0])
+        if args.dump_insts and period:
+            limit = min(limit, interval[1] + period)
+        exit_event = m5.simulate(limit - m5.curTick())
+        if exit_event.getCause().startswith("dump insts "):
+            # In global mode every counted core keeps exactly one stop outstanding, armed for its share
+            # of what's left; only the core whose stop fired is re-armed
+            fired = int(exit_event.getCause().split()[-1])
+            counts = InstCounts(cpus)
+            remaining = args.dump_insts - sum(counts[i] - interval[2][i] for i in counted)
+            if remaining <= 0:
+                EndInterval(cpus, "insts")
+                remaining = args.dump_insts
+            cpus[fired].scheduleInstStop(0, -(-remaining//len(counted)), "dump insts %i" % fired)
+        elif exit_event.getCause() == "simulate() limit reached" and m5.curTick() < args.stop_at_tick:
+            if args.dump_insts and period and m5.curTick() >= interval[1] + period:
+                EndInterval(cpus, "time")
+        else:
+            break
+    # The final dump happens at exit
+    if args.dump_insts:
+        EndInterval(cpus, exit_event.getCause(), dump=False)
 print("Exiting at tick %i because %s" % (m5.curTick(), exit_event.getCause()))
@@ -0,0 +1,105 @@
+#!/usr/bin/python3
+
+import argparse
+import os
+import re
+import subprocess as sproc
+import sys
+
+import gem5stats
+import mcpatrun
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+resultPattern = re.compile(r"^result: test=(\w+) threads=(\d+) ops=(\d+) cycles=(\d+)")
+
+
+def ParseFrequency(freq):
+    match = re.match(r"^([\d.]+)\s*([kMG]?)Hz$", freq)
+    if not match:
+        raise ValueError('Bad frequency: ' + freq)
+    return float(match.group(1))*{'': 1, 'k': 1e3, 'M': 1e6, 'G': 1e9}[match.group(2)]
+
+
+def CpuNames(cores):
+    # gem5 drops the index from a lone CPU's name
+    return ['system.cpu'] if cores == 1 else ['system.cpu%d' % i for i in range(cores)]
+
+
+def CoherenceTraffic(dump, cores):
+    # Snoops seen by the crossbars plus upgrades that had to be resolved below the L1s
+    traffic = {}
+    traffic['snoops'] = gem5stats.Sum(dump, ['system.membus.snoops', 'system.tol2bus.snoops'])
+    traffic['snoop_bytes'] = gem5stats.Sum(dump, ['system.membus.snoop_traffic', 'system.tol2bus.snoop_traffic'])
+    traffic['upgrades'] = gem5stats.Sum(dump, ['%s.dcache.%sUpgradeReq_mshr_misses::total' % (cpu, kind)
+                                               for cpu in CpuNames(cores) for kind in ('', 'SC')])
+    return traffic
+
+
+corePattern = re.compile(r"^(FPU|EXE|IRF|MUL|FPRF|ROB|IntReservationStation|FPReservationStation|IntFrontRAT|"
+                         r"UnifiedFreeList|FPFrontRAT|dtlb|itlb|ID|BTB|IB|RBB|icache|LSQ|LQ|dcache)(\d+)$")
+
+
+def CorePower(names, watts, cores):
+    # Per-core floorplan blocks are numbered from 1 (FPU1, dcache1, ...); MC, L2 and NoC blocks
+    # are shared and left out
+    power = [0.0]*cores
+    for name, w in zip(names, watts):
+        match = corePattern.match(name)
+        if match and 1 <= int(match.group(2)) <= cores:
+            power[int(match.group(2)) - 1] += w
+    return power
+
+
+parser = argparse.ArgumentParser(description='Sweep the atomic contention benchmark across core counts.')
+parser.add_argument('-c', '--cores', type=int, nargs='+', default=[1, 2, 4, 8],
+                    help='core counts to simulate (one thread per core)')
+parser.add_argument('-i', '--iterations', type=int, default=1000,
+                    help='iterations per thread')
+parser.add_argument('-t', '--test', choices=['counter', 'ticket', 'queue', 'all'], default='all',
+                    help='contention pattern to run')
+parser.add_argument('-b', '--binary', default=os.path.join(root, 'test/atomic/atomic'),
+                    help='RISC-V build of test/atomic/atomic.cpp')
+parser.add_argument('--gem5', default=os.path.join(root, 'lib/gem5-riscv/build/RISCV/gem5.opt'),
+                    help='gem5 binary')
+parser.add_argument('--cpu-type', default='detailed',
+                    help='config/run.py CPU model')
+parser.add_argument('-f', '--cpu-frequency', default='3.7GHz',
+                    help='CPU clock rate')
+parser.add_argument('--run-args', default='--caches --l2cache 2MB 8',
+                    help='extra config/run.py arguments')
+parser.add_argument('--power', action='store_true',
+                    help='run McPAT on each result and report per-core power')
+parser.add_argument('-o', '--outdir', default='atomicscale',
+                    help='directory for per-run gem5 output')
+args = parser.parse_args()
+
+freq = ParseFrequency(args.cpu_frequency)
+print('%5s %8s %12s %14s %12s %14s %10s  %s' % ('cores', 'test', 'ops', 'ops/sec', 'snoops', 'snoop bytes', 'upgrades', 'core power (W)'))
+for n in args.cores:
+    m5out = os.path.join(args.outdir, 'n%d' % n)
+    os.makedirs(m5out, exist_ok=True)
+    gem5_args = [args.gem5, '-d', m5out, os.path.join(root, 'config/run.py'),
+                 '--cpu-type', args.cpu_type, '-n', str(n), '-f', args.cpu_frequency] + \
+        args.run_args.split() + \
+        ['%s %d %d %s' % (args.binary, n, args.iterations, args.test)]
+    with open(os.path.join(m5out, 'gem5.log'), 'w') as log:
+        if sproc.call(gem5_args, stdout=log, stderr=sproc.STDOUT) != 0:
+            print('gem5 failed for %d cores; see %s' % (n, log.name), file=sys.stderr)
+            continue
+
+    dump = gem5stats.ReadLastDump(os.path.join(m5out, 'stats.txt'))
+    traffic = CoherenceTraffic(dump, n)
+    power = ''
+    if args.power:
+        names, watts = mcpatrun.RunMcPAT(m5out)
+        power = ' '.join('%.3f' % w for w in CorePower(names, watts, n))
+    with open(os.path.join(m5out, 'gem5.log'), 'r') as log:
+        for line in log:
+            match = resultPattern.match(line)
+            if match:
+                ops = int(match.group(3))
+                cycles = int(match.group(4))
+                rate = ops*freq/cycles if cycles else 0.0
+                print('%5d %8s %12d %14.4g %12d %14d %10d  %s' % (n, match.group(1), ops, rate,
+                      traffic['snoops'], traffic['snoop_bytes'], traffic['upgrades'], power))
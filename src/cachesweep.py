@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+
+import argparse
+import itertools
+import os
+import re
+import subprocess as sproc
+import sys
+import time
+
+import gem5stats
+import simmanager as sim
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+l2Pattern = re.compile(r"^(system\.l2\d*)\.")
+
+
+def MissRate(dump, caches):
+    accesses = gem5stats.Sum(dump, [c + '.demand_accesses::total' for c in caches])
+    misses = gem5stats.Sum(dump, [c + '.demand_misses::total' for c in caches])
+    return misses/accesses if accesses else 0.0
+
+
+def Summarize(m5out, cores):
+    # Sum the dumps; a single L1D is system.cpu, several are system.cpu0, system.cpu1, ...
+    total = {}
+    with open(os.path.join(m5out, 'stats.txt'), 'r') as fd:
+        for dump in gem5stats.ReadDumps(fd):
+            for name, value in dump.items():
+                total[name] = total.get(name, 0.0) + value
+    l1d = ['system.cpu.dcache'] + ['system.cpu%d.dcache' % i for i in range(cores)]
+    # One L2 is system.l2; banks are system.l20, system.l21, ... however many there are
+    l2 = sorted(set(match.group(1) for match in (l2Pattern.match(name) for name in total) if match))
+    return {'sim_seconds': total.get('sim_seconds', 0.0),
+            'l1d_miss': MissRate(total, l1d),
+            'l2_miss': MissRate(total, l2)}
+
+
+parser = argparse.ArgumentParser(description='Record an elastic trace once and replay it across L1D and L2 configurations.')
+parser.add_argument('command', nargs='?', default=None,
+                    help='workload command line (quoted); not needed with --trace')
+parser.add_argument('--trace', default=None,
+                    help='replay an existing trace prefix instead of recording one')
+parser.add_argument('-n', '--cores', type=int, default=1,
+                    help='number of cores')
+parser.add_argument('--l1d-sets', type=int, nargs='+', default=[64],
+                    help='L1D set counts to sweep')
+parser.add_argument('--l1d-ways', type=int, nargs='+', default=[4],
+                    help='L1D associativities to sweep')
+parser.add_argument('--l2-kb', type=int, nargs='+', default=[256],
+                    help='L2 capacities in kB to sweep')
+parser.add_argument('--l2-ways', type=int, default=8,
+                    help='L2 associativity')
+parser.add_argument('--line', type=int, default=64,
+                    help='cache line size in bytes')
+parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                    help='replays to run concurrently')
+parser.add_argument('--gem5', default=os.path.join(root, 'lib/gem5-riscv/build/RISCV/gem5.opt'),
+                    help='gem5 binary')
+parser.add_argument('--run-args', default='',
+                    help='extra config/run.py arguments for recording and replay')
+parser.add_argument('-o', '--outdir', default='cachesweep',
+                    help='directory for the trace and per-point results')
+args = parser.parse_args()
+
+outdir = os.path.abspath(args.outdir)
+os.makedirs(outdir, exist_ok=True)
+run_py = os.path.join(root, 'config/run.py')
+
+trace = args.trace
+if not trace:
+    if not args.command:
+        print('Need a workload to record or an existing --trace', file=sys.stderr)
+        sys.exit(1)
+    record = os.path.join(outdir, 'record')
+    print('Recording elastic trace...')
+    start = time.time()
+    sproc.check_call([args.gem5, '-d', record, run_py, '--cpu-type', 'detailed', '--caches',
+                      '-n', str(args.cores), '--cacheline-size', str(args.line), '--etrace-record'] +
+                     args.run_args.split() + [args.command],
+                     stdout=open(os.path.join(outdir, 'record.log'), 'w'), stderr=sproc.STDOUT)
+    print('Recorded in %.1f s' % (time.time() - start))
+    trace = os.path.join(record, 'etrace')
+
+points = list(itertools.product(args.l1d_sets, args.l1d_ways, args.l2_kb))
+sman = sim.SimManager()
+pending = list(points)
+running = {}
+elapsed = {}
+while pending or running:
+    while pending and len(running) < args.jobs:
+        sets, ways, l2_kb = point = pending.pop(0)
+        name = 's%d_w%d_l2%dk' % point
+        replay_args = '%s -d %s %s --etrace-replay %s -n %d --caches --cacheline-size %d --dcache %dB %d --l2cache %dkB %d %s' % \
+            (args.gem5, os.path.join(outdir, name), run_py, trace, args.cores, args.line,
+             sets*ways*args.line, ways, l2_kb, args.l2_ways, args.run_args)
+        running[point] = (time.time(), sman.StartTool(name, replay_args,
+                                                      stdout=open(os.path.join(outdir, name + '.log'), 'w'), stderr=sproc.STDOUT))
+    for point, (start, proc) in list(running.items()):
+        if proc.poll() is not None:
+            elapsed[point] = time.time() - start
+            if proc.returncode != 0:
+                print('Replay %s failed (%d)' % (point, proc.returncode), file=sys.stderr)
+            del running[point]
+    time.sleep(0.5)
+
+print('%8s %6s %8s %14s %10s %10s %10s' % ('L1D sets', 'ways', 'L2 (kB)', 'sim time (s)', 'L1D miss', 'L2 miss', 'wall (s)'))
+for point in points:
+    m5out = os.path.join(outdir, 's%d_w%d_l2%dk' % point)
+    if not os.path.exists(os.path.join(m5out, 'stats.txt')):
+        continue
+    result = Summarize(m5out, args.cores)
+    print('%8d %6d %8d %14.6g %9.2f%% %9.2f%% %10.1f' % (point + (result['sim_seconds'], 100*result['l1d_miss'],
+                                                          100*result['l2_miss'], elapsed.get(point, 0.0))))
@@ -0,0 +1,198 @@
+#!/usr/bin/python3
+
+import argparse
+import gzip
+import json
+import os
+import re
+import sys
+
+import numpy as np
+
+import mcpatrun
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+execPattern = re.compile(r"^\s*(\d+): system\.(?:switch_)?cpus?(\d*) ")
+branchPattern = re.compile(r"^(c\.)?(b|j|ret)")
+
+# Stats one committed instruction of each kind adds under system.cpuN, following the
+# Penryn.xml template.  Every kind carries the front-end and ROB work of an instruction.
+common = {'decode.DecodedInsts': 1, 'commit.committedOps': 1, 'rob.rob_reads': 1, 'rob.rob_writes': 1,
+          'rename.RenamedOperands': 2, 'icache.ReadReq_accesses::total': 0.25}
+integer = {'iq.int_inst_queue_reads': 1, 'iq.int_inst_queue_writes': 1, 'iq.int_inst_queue_wakeup_accesses': 1,
+           'rename.int_rename_lookups': 2, 'int_regfile_reads': 2, 'int_regfile_writes': 1,
+           'commit.int_insts': 1}
+bundles = {'IntAlu': dict(common, **dict(integer, **{'iq.int_alu_accesses': 1, 'iq.FU_type_0::IntAlu': 1})),
+           'IntMult': dict(common, **dict(integer, **{'iq.int_alu_accesses': 1, 'iq.FU_type_0::IntMult': 1})),
+           'IntDiv': dict(common, **dict(integer, **{'iq.int_alu_accesses': 1, 'iq.FU_type_0::IntDiv': 1})),
+           'Float': dict(common, **{'iq.fp_alu_accesses': 1, 'iq.fp_inst_queue_reads': 1, 'iq.fp_inst_queue_writes': 1,
+                                    'iq.fp_inst_queue_wakeup_accesses': 1, 'rename.fp_rename_lookups': 2,
+                                    'fp_regfile_reads': 2, 'fp_regfile_writes': 1, 'commit.fp_insts': 1}),
+           'MemRead': dict(common, **dict(integer, **{'iq.FU_type_0::MemRead': 1, 'iew.iewExecLoadInsts': 1,
+                                                      'dcache.ReadReq_accesses::total': 1, 'int_regfile_reads': 1})),
+           'MemWrite': dict(common, **dict(integer, **{'iq.FU_type_0::MemWrite': 1, 'iew.exec_stores': 1,
+                                                       'dcache.WriteReq_accesses::total': 1})),
+           # Added on top of the instruction's own kind
+           'Branch': {'branchPred.lookups': 1, 'branchPred.BTBLookups': 1}}
+kinds = sorted(bundles)
+
+# gem5 op classes to bundle kinds; anything else (e.g. No_OpClass macro-op lines) is skipped
+opClasses = {'IntAlu': 'IntAlu', 'IprAccess': 'IntAlu', 'IntMult': 'IntMult', 'IntDiv': 'IntDiv',
+             'MemRead': 'MemRead', 'FloatMemRead': 'MemRead', 'MemWrite': 'MemWrite', 'FloatMemWrite': 'MemWrite'}
+
+
+def Kind(op_class):
+    if op_class in opClasses:
+        return opClasses[op_class]
+    if op_class.startswith('Float') or op_class.startswith('Simd'):
+        return 'Float'
+    return None
+
+
+def WriteStats(filename, clock, counts):
+    # A one-cycle dump, the interval the Penryn template models (total_cycles = 1 per core)
+    with open(filename, 'w') as fd:
+        fd.write('\n---------- Begin Simulation Statistics ----------\n')
+        fd.write('sim_seconds %.12g\n' % (1/clock))
+        fd.write('sim_ticks %d\n' % round(1e12/clock))
+        for name, value in sorted(counts.items()):
+            fd.write('%s %g\n' % (name, value))
+        fd.write('\n---------- End Simulation Statistics   ----------\n')
+
+
+def Calibrate(args):
+    # One McPAT run with every core busy and no activity gives the idle (leakage and clock)
+    # power; one more per core and kind, each adding a single event, gives the energy of that
+    # event in every block.  McPAT's dynamic power is linear in the access counts.
+    config = os.path.abspath(os.path.join(args.m5out, 'config.json'))
+    idle = dict(('system.cpu%d.numCycles' % core, 1) for core in range(args.cores))
+
+    def Run(name, counts):
+        rundir = os.path.join(args.outdir, 'calibrate', name)
+        if not os.path.exists(rundir):
+            os.makedirs(rundir)
+        WriteStats(os.path.join(rundir, 'stats.txt'), args.clock, counts)
+        if not os.path.exists(os.path.join(rundir, 'config.json')):
+            os.symlink(config, os.path.join(rundir, 'config.json'))
+        return mcpatrun.RunMcPAT(rundir, template=args.template)
+
+    names, base = Run('idle', idle)
+    base = np.array(base)
+    energy = []
+    for core in range(args.cores):
+        for kind in kinds:
+            print('Calibrating cpu%d %s...' % (core, kind))
+            counts = dict(idle)
+            for stat, n in bundles[kind].items():
+                name = 'system.cpu%d.%s' % (core, stat)
+                counts[name] = counts.get(name, 0) + n
+            _, power = Run('cpu%d_%s' % (core, kind), counts)
+            # One event within one cycle: joules = extra watts / clock
+            energy.append(list(np.maximum(np.array(power) - base, 0.0)/args.clock))
+    with open(args.energy, 'w') as fd:
+        json.dump({'clock': args.clock, 'cores': args.cores, 'kinds': kinds,
+                   'names': names, 'idle': list(base), 'energy': energy}, fd, indent=1)
+
+
+def Events(fd, ticks_per_cycle, columns):
+    # (cycle, column) for every committed instruction in a gem5 Exec trace
+    # (--debug-flags=ExecEnable,ExecOpClass); a branch yields a second event
+    for line in fd:
+        match = execPattern.match(line)
+        if not match:
+            continue
+        fields = line.split(' : ')
+        if len(fields) < 4:
+            continue
+        kind = Kind(fields[3].strip())
+        if kind is None:
+            continue
+        core = int(match.group(2) or 0)
+        cycle = int(match.group(1))//ticks_per_cycle
+        yield cycle, columns[core][kind]
+        if branchPattern.match(fields[2].strip()):
+            yield cycle, columns[core]['Branch']
+
+
+def Synthesize(args):
+    with open(args.energy, 'r') as fd:
+        model = json.load(fd)
+    names = model['names']
+    idle = np.array(model['idle'])
+    # Watts for one event in a cycle, one row per (core, kind) column
+    watts = np.array(model['energy'])*model['clock']
+    columns = [dict((kind, core*len(model['kinds']) + i) for i, kind in enumerate(model['kinds']))
+               for core in range(model['cores'])]
+    order = [names.index(block[0]) for block in spotfiles.ReadFloorplan(args.floorplan)] \
+        if args.floorplan else list(range(len(names)))
+    ticks_per_cycle = int(round(1e12/model['clock']))
+    chunk = args.chunk
+    width = len(watts)
+
+    trace = sys.stdin if args.trace == '-' else \
+        gzip.open(args.trace, 'rt') if args.trace.endswith('.gz') else open(args.trace, 'r')
+    out = sys.stdout if args.output == '-' else open(args.output, 'w')
+    out.write('\t'.join(names[i] for i in order) + '\n')
+
+    def Flush(rows, indices):
+        # Per-cycle event counts -> per-cycle block power, written as a block of ptrace rows
+        counts = np.bincount(indices, minlength=rows*width)[:rows*width].reshape(rows, width) \
+            if indices else np.zeros((rows, width))
+        power = idle + counts.dot(watts)
+        np.savetxt(out, power[:, order], fmt='%.6g', delimiter='\t')
+        out.flush()
+
+    start = None
+    indices = []
+    for cycle, column in Events(trace, ticks_per_cycle, columns):
+        if start is None:
+            # Rows start at the first traced cycle so a fast-forwarded prefix isn't padded out
+            start = cycle
+        while cycle >= start + chunk:
+            Flush(chunk, indices)
+            start += chunk
+            indices = []
+        # Out-of-order lines (parallel event queues) land in the oldest cycle still buffered
+        indices.append((max(cycle, start) - start)*width + column)
+    if start is not None and indices:
+        Flush(max(indices)//width + 1, indices)
+    if out is not sys.stdout:
+        out.close()
+
+
+parser = argparse.ArgumentParser(description='Synthesize a cycle-resolution power trace from per-event McPAT energies and a gem5 Exec trace.')
+parser.add_argument('mode', choices=['calibrate', 'synthesize'],
+                    help='compute per-event energies with McPAT, or turn an Exec trace into a per-cycle ptrace')
+parser.add_argument('-t', '--trace', default='-',
+                    help='gem5 Exec trace (--debug-flags=ExecEnable,ExecOpClass; a FIFO as --debug-file streams it), or - for stdin')
+parser.add_argument('-e', '--energy', default='energy.json',
+                    help='per-event energy table written by calibrate and read by synthesize')
+parser.add_argument('--m5out', default='m5out',
+                    help='gem5 output directory whose config.json describes the system to calibrate')
+parser.add_argument('-n', '--cores', type=int, default=2,
+                    help='number of cores to calibrate')
+parser.add_argument('--clock', type=float, default=None,
+                    help='core clock in Hz (default: proc_clock_freq from the VoltSpot config)')
+parser.add_argument('--template', default=os.path.join(root, 'config/Penryn.xml'),
+                    help='McPAT template')
+parser.add_argument('-c', '--config', default=os.path.join(root, 'config/voltspot.config'),
+                    help='VoltSpot config file')
+parser.add_argument('-f', '--floorplan', default=os.path.join(root, 'config/penryn.flp'),
+                    help='floorplan whose block order the ptrace columns follow')
+parser.add_argument('--chunk', type=int, default=4096,
+                    help='cycles buffered before a block of rows is written')
+parser.add_argument('-o', '--output', default='-',
+                    help='output ptrace, or - for stdout')
+parser.add_argument('--outdir', default='cyclepower',
+                    help='directory for calibration runs')
+args = parser.parse_args()
+
+if args.clock is None:
+    args.clock = float(spotfiles.ReadConfig(args.config)['proc_clock_freq'])
+
+if args.mode == 'calibrate':
+    Calibrate(args)
+else:
+    Synthesize(args)
@@ -0,0 +1,126 @@
+#!/usr/bin/python3
+
+import argparse
+import gzip
+import math
+import os
+import subprocess as sproc
+import sys
+
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+def Resonances(config, floorplan):
+    # First-order PDN resonances from the VoltSpot parameters.  The die resonance is the
+    # on-chip decap against the package series inductance plus the Vdd and Gnd pad
+    # inductances in parallel; the package resonance is the package capacitor against its
+    # own parallel inductance.
+    width, height = spotfiles.ChipSize(floorplan)
+    pitch = float(config['PDN_padpitch'])
+    pads = int(width/pitch)*int(height/pitch)
+    area = width*height*1e6     # mm^2
+    c_die = float(config['PDN_decap_dense'])*1e-9*area*float(config['PDN_decap_ratio'])
+    l_die = float(config['PDN_pkg_sL']) + 2*float(config['PDN_padL'])/(pads/2)
+    l_pkg = float(config['PDN_pkg_sL']) + float(config['PDN_pkg_pL'])
+    c_pkg = float(config['PDN_pkg_C'])
+    return {'die': 1/(2*math.pi*math.sqrt(l_die*c_die)),
+            'package': 1/(2*math.pi*math.sqrt(l_pkg*c_pkg))}
+
+
+def Build(args, period):
+    binary = os.path.join(args.outdir, 'didt_%d' % period)
+    if not os.path.exists(binary):
+        sproc.check_call([args.cxx, '-O2', '-std=c++11', '-static',
+                          '-DPERIOD_CYCLES=%d' % period,
+                          '-DDUTY_PERCENT=%d' % args.duty,
+                          '-DPERIODS=%d' % args.periods,
+                          '-o', binary, os.path.join(root, 'test/didt/didt.cpp')])
+    return binary
+
+
+def Simulate(args, period, vdd):
+    binary = Build(args, period)
+    outdir = os.path.join(args.outdir, 'p%d' % period)
+    dump_period = 1e3/args.clock     # one cycle, in ms
+    sproc.check_call(['python3', os.path.join(root, 'src/reclaim.py'),
+                      '-o', outdir, '--no-video', '--gem5', args.gem5,
+                      os.path.join(root, 'config/run.py'),
+                      '--cpu-type', args.cpu_type, '-f', '%gHz' % args.clock,
+                      '-d', '%g' % dump_period] + args.run_args.split() + [binary])
+    with gzip.open(os.path.join(outdir, 'voltspot.gridvol.gz'), 'rt') as fd:
+        return spotfiles.GridDroop(fd, vdd)[0]
+
+
+parser = argparse.ArgumentParser(description='Generate and sweep di/dt stress kernels against the PDN resonance.')
+parser.add_argument('mode', choices=['resonance', 'build', 'sweep'],
+                    help='report the PDN resonances, build kernels for --period, or sweep the period for maximum droop')
+parser.add_argument('-c', '--config', default=os.path.join(root, 'config/voltspot.config'),
+                    help='VoltSpot config file')
+parser.add_argument('-f', '--floorplan', default=os.path.join(root, 'config/penryn.flp'),
+                    help='floorplan file')
+parser.add_argument('-p', '--period', type=int, nargs='+', default=None,
+                    help='kernel periods in cycles (default: around the die resonance)')
+parser.add_argument('--duty', type=int, default=50,
+                    help='percentage of each period spent in the FMA burst')
+parser.add_argument('--periods', type=int, default=1000,
+                    help='number of periods the kernel runs')
+parser.add_argument('--points', type=int, default=9,
+                    help='coarse sweep points between 1/4x and 4x the resonant period')
+parser.add_argument('--refine', type=int, default=4,
+                    help='extra points around the best coarse period')
+parser.add_argument('--cxx', default='riscv64-unknown-elf-g++',
+                    help='RISC-V C++ compiler')
+parser.add_argument('--gem5', default=os.path.join(root, 'lib/gem5-riscv/build/RISCV/gem5.opt'),
+                    help='gem5 binary')
+parser.add_argument('--cpu-type', default='detailed',
+                    help='config/run.py CPU model')
+parser.add_argument('--run-args', default='--caches',
+                    help='extra config/run.py arguments')
+parser.add_argument('-o', '--outdir', default='didt',
+                    help='directory for kernels and simulation output')
+args = parser.parse_args()
+
+config = spotfiles.ReadConfig(args.config)
+args.clock = float(config['proc_clock_freq'])
+vdd = float(config['vdd'])
+resonance = Resonances(config, spotfiles.ReadFloorplan(args.floorplan))
+resonant_period = int(round(args.clock/resonance['die']))
+
+if args.mode == 'resonance':
+    for name, f in sorted(resonance.items()):
+        print('%-8s %10.4g Hz  %10.1f cycles' % (name, f, args.clock/f))
+    sys.exit(0)
+
+if not os.path.exists(args.outdir):
+    os.makedirs(args.outdir)
+if args.period:
+    periods = args.period
+else:
+    periods = sorted(set(max(2, int(round(resonant_period*4**(2.0*i/(args.points - 1) - 1))))
+                         for i in range(args.points)))
+
+if args.mode == 'build':
+    for period in periods:
+        print(Build(args, period))
+    sys.exit(0)
+
+print('die resonance: %.4g Hz (%d cycles)' % (resonance['die'], resonant_period))
+droops = {}
+for period in periods:
+    droops[period] = Simulate(args, period, vdd)
+    print('period %6d cycles  %10.4g Hz  droop %.4f V' % (period, args.clock/period, droops[period]))
+if not args.period and args.refine > 0:
+    # Refine between the neighbours of the best coarse point
+    ordered = sorted(droops)
+    best = ordered.index(max(droops, key=droops.get))
+    low = ordered[max(best - 1, 0)]
+    high = ordered[min(best + 1, len(ordered) - 1)]
+    for i in range(1, args.refine + 1):
+        period = int(round(low + (high - low)*i/(args.refine + 1.0)))
+        if period not in droops:
+            droops[period] = Simulate(args, period, vdd)
+            print('period %6d cycles  %10.4g Hz  droop %.4f V' % (period, args.clock/period, droops[period]))
+best = max(droops, key=droops.get)
+print('worst droop %.4f V (%.2f%% of Vdd) at %d cycles (%.4g Hz)' % (droops[best], 100*droops[best]/vdd, best, args.clock/best))
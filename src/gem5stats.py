@@ -0,0 +1,42 @@
+#!/usr/bin/python3
+from collections import OrderedDict
+
+
+def ReadDumps(fd):
+    # Yield one OrderedDict of stat name -> value per dump in a gem5 stats.txt stream
+    dump = None
+    for line in fd:
+        if line.startswith('---------- Begin Simulation Statistics'):
+            dump = OrderedDict()
+        elif line.startswith('---------- End Simulation Statistics'):
+            if dump is not None:
+                yield dump
+            dump = None
+        elif dump is not None:
+            fields = line.split()
+            if len(fields) >= 2:
+                try:
+                    dump[fields[0]] = float(fields[1])
+                except ValueError:
+                    pass
+
+
+def ReadLastDump(filename):
+    dump = OrderedDict()
+    with open(filename, 'r') as fd:
+        for dump in ReadDumps(fd):
+            pass
+    return dump
+
+
+def Sum(dump, names):
+    # Sum a set of stats, treating missing ones as zero like GEM5ToMcPAT does
+    return sum(dump.get(name, 0.0) for name in names)
+
+
+def WriteDump(fd, dump):
+    # One dump in stats.txt form, readable by ReadDumps and GEM5ToMcPAT
+    fd.write('\n---------- Begin Simulation Statistics ----------\n')
+    for name, value in dump.items():
+        fd.write('%s %.12g\n' % (name, value))
+    fd.write('\n---------- End Simulation Statistics   ----------\n')
@@ -0,0 +1,250 @@
+#!/usr/bin/python3
+
+import argparse
+import os
+import subprocess as sproc
+import sys
+import time
+
+import numpy as np
+
+import simmanager as sim
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+def HotSpotArgs(args, ptrace, ttrace, interval, init_temp, grid=None):
+    return '%s -f %s -p %s -c %s -o %s -sampling_intvl %g -init_temp %g%s' % \
+        (args.hotspot, args.floorplan, ptrace, args.config, ttrace, interval, init_temp,
+         ' -grid_trans_file %s' % grid if grid else '')
+
+
+def ReadResponse(args, rundir):
+    # Block temperatures, or grid cells flattened row by row, one row per HotSpot step
+    if args.grid:
+        with open(os.path.join(rundir, 'grid.ttrace'), 'r') as fd:
+            return np.array([np.array(frame).ravel() for frame in spotfiles.ReadGridFrames(fd)])
+    with open(os.path.join(rundir, 'hotspot.ttrace'), 'r') as fd:
+        names, rows = spotfiles.ReadPtrace(fd)
+    return np.array(rows)
+
+
+def ReadResponseShape(args):
+    with open(os.path.join(args.outdir, 'zero_0', 'grid.ttrace'), 'r') as fd:
+        frame = next(spotfiles.ReadGridFrames(fd))
+    return [len(frame), len(frame[0])]
+
+
+def Characterize(args, blocks, ambient, init_temp):
+    # A unit power step on each block, started from ambient, at each interval; plus a zero-power
+    # run from HotSpot's initial temperature.  The grid model is linear with leakage disabled,
+    # so these runs describe its response to any power trace.
+    names = [b[0] for b in blocks]
+    runs = []
+    for i, interval in enumerate(args.intervals):
+        runs.append(('zero_%d' % i, None, interval))
+        for b in range(len(names)):
+            runs.append(('step%d_%d' % (b, i), b, interval))
+    sman = sim.SimManager()
+    pending = list(runs)
+    running = {}
+    while pending or running:
+        while pending and len(running) < args.jobs:
+            name, block, interval = pending.pop(0)
+            rundir = os.path.join(args.outdir, name)
+            if not os.path.exists(rundir):
+                os.makedirs(rundir)
+            power = [0.0]*len(names)
+            if block is not None:
+                power[block] = 1.0
+            with open(os.path.join(rundir, 'ptrace.txt'), 'w') as fd:
+                spotfiles.WritePtrace(fd, names, [power]*args.steps)
+            command = HotSpotArgs(args, os.path.join(rundir, 'ptrace.txt'), os.path.join(rundir, 'hotspot.ttrace'),
+                                  interval, init_temp if block is None else ambient,
+                                  os.path.join(rundir, 'grid.ttrace') if args.grid else None)
+            running[name] = sman.StartTool(name, command, stdout=open(os.path.join(rundir, 'hotspot.log'), 'w'),
+                                           stderr=sproc.STDOUT)
+        for name, proc in list(running.items()):
+            if proc.poll() is not None:
+                if proc.returncode != 0:
+                    print('HotSpot failed for %s (%d)' % (name, proc.returncode), file=sys.stderr)
+                    sys.exit(1)
+                del running[name]
+        time.sleep(0.5)
+
+    # Fit every response to a sum of exponentials with fixed, log-spaced time constants: a
+    # linear least-squares problem, solved for all blocks and targets at once
+    times = np.concatenate([interval*np.arange(1, args.steps + 1) for interval in args.intervals])
+    taus = np.logspace(np.log10(min(args.intervals)/2), np.log10(10*max(args.intervals)*args.steps), args.modes)
+    rise = 1 - np.exp(-times[:, None]/taus[None, :])
+    decay = np.exp(-times[:, None]/taus[None, :])
+    steps = np.array([np.concatenate([ReadResponse(args, os.path.join(args.outdir, 'step%d_%d' % (b, i)))[:args.steps] - ambient
+                                      for i in range(len(args.intervals))]) for b in range(len(names))])
+    zero = np.concatenate([ReadResponse(args, os.path.join(args.outdir, 'zero_%d' % i))[:args.steps] - ambient
+                           for i in range(len(args.intervals))])
+    targets = steps.shape[2]
+    amps = np.linalg.lstsq(rise, steps.transpose(1, 0, 2).reshape(len(times), -1), rcond=None)[0]
+    amps = amps.reshape(args.modes, len(names), targets)
+    initial = np.linalg.lstsq(decay, zero, rcond=None)[0]
+    residual = np.abs(np.einsum('tm,mbj->btj', rise, amps) - steps).max()
+    print('%d blocks, %d targets, %d modes; worst fit error %.4g K' % (len(names), targets, args.modes, residual))
+    np.savez(args.model, names=names, taus=taus, amps=amps, initial=initial, ambient=ambient,
+             shape=np.array(ReadResponseShape(args) if args.grid else [targets]))
+
+
+def Powers(model, filename):
+    # Ptrace columns in the model's block order; blocks the trace doesn't name draw no power
+    with open(filename, 'r') as fd:
+        names, rows = spotfiles.ReadPtrace(fd)
+    rows = np.array(rows)
+    power = np.zeros((len(rows), len(model['names'])))
+    for i, name in enumerate(model['names']):
+        if name in names:
+            power[:, i] = rows[:, names.index(name)]
+    return power
+
+
+def PredictFFT(model, power, interval):
+    # Sampled step responses -> discrete impulse responses for a zero-order-hold input, then one
+    # FFT convolution per source block
+    n = len(power)
+    taus, amps = model['taus'], model['amps']
+    t = interval*np.arange(n + 1)
+    basis = 1 - np.exp(-t[:, None]/taus[None, :])
+    size = 1 << (2*n - 1).bit_length()
+    spectrum = np.zeros((size//2 + 1, amps.shape[2]), dtype=complex)
+    for b in range(amps.shape[1]):
+        if power[:, b].any():
+            impulse = np.diff(basis.dot(amps[:, b, :]), axis=0)
+            spectrum += np.fft.rfft(power[:, b], size)[:, None]*np.fft.rfft(impulse, size, axis=0)
+    rise = np.fft.irfft(spectrum, size, axis=0)[:n]
+    return rise + Initial(model, interval, n)
+
+
+def PredictRecursive(model, power, interval):
+    # One first-order filter per mode, block and target; exact for a zero-order-hold input
+    taus, amps = model['taus'], model['amps']
+    alpha = np.exp(-interval/taus)
+    gain = np.einsum('m,mbj->mbj', 1 - alpha, amps)
+    state = np.zeros((len(taus), amps.shape[2]))
+    rise = np.zeros((len(power), amps.shape[2]))
+    for k in range(len(power)):
+        state = alpha[:, None]*state + np.einsum('b,mbj->mj', power[k], gain)
+        rise[k] = state.sum(axis=0)
+    return rise + Initial(model, interval, len(power))
+
+
+def Initial(model, interval, n):
+    # Temperatures at the end of each interval with no power: the decay from HotSpot's initial
+    # temperature towards ambient
+    t = interval*np.arange(1, n + 1)
+    return model['ambient'] + np.exp(-t[:, None]/model['taus'][None, :]).dot(model['initial'])
+
+
+def Predict(args, model, power):
+    start = time.time()
+    if args.method == 'fft':
+        temps = PredictFFT(model, power, args.interval)
+    else:
+        temps = PredictRecursive(model, power, args.interval)
+    return temps, time.time() - start
+
+
+def WriteTemps(fd, model, temps):
+    if len(model['shape']) == 2:
+        # Grid frames, blank-line separated like -grid_trans_file
+        for row in temps:
+            np.savetxt(fd, row.reshape(model['shape']), fmt='%.2f', delimiter='\t')
+            fd.write('\n')
+    else:
+        fd.write('\t'.join(model['names']) + '\n')
+        np.savetxt(fd, temps, fmt='%.2f', delimiter='\t')
+
+
+parser = argparse.ArgumentParser(description='Linear time-invariant thermal model: characterize HotSpot once, then predict temperatures by convolution.')
+parser.add_argument('mode', choices=['characterize', 'predict', 'validate'],
+                    help='build the model from HotSpot step responses, predict temperatures for a ptrace, or compare a prediction with HotSpot')
+parser.add_argument('-p', '--ptrace', default='ptrace.txt',
+                    help='power trace to predict or validate')
+parser.add_argument('-m', '--model', default='ltithermal.npz',
+                    help='model file')
+parser.add_argument('-i', '--interval', type=float, default=None,
+                    help='ptrace row interval in seconds (default: sampling_intvl from the HotSpot config)')
+parser.add_argument('--method', choices=['fft', 'recursive'], default='fft',
+                    help='FFT convolution over the whole trace, or recursive filtering row by row')
+parser.add_argument('--ttrace', default=None,
+                    help='existing HotSpot block temperatures to validate against instead of running HotSpot')
+parser.add_argument('-o', '--output', default='-',
+                    help='predicted temperatures (block ttrace, or grid frames for a grid model), or - for stdout')
+parser.add_argument('--grid', action='store_true',
+                    help='characterize grid cell temperatures (-grid_trans_file) instead of block temperatures')
+parser.add_argument('--intervals', type=float, nargs='+', default=[1e-6, 1e-4, 1e-2, 1.0],
+                    help='HotSpot sampling intervals of the characterization runs, covering fast to slow time constants')
+parser.add_argument('--steps', type=int, default=100,
+                    help='steps per characterization run')
+parser.add_argument('--modes', type=int, default=24,
+                    help='exponential modes in the fitted responses')
+parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                    help='HotSpot runs to start concurrently')
+parser.add_argument('-c', '--config', default=os.path.join(root, 'config/hotspot.config'),
+                    help='HotSpot config file')
+parser.add_argument('-f', '--floorplan', default=os.path.join(root, 'config/penryn.flp'),
+                    help='floorplan file')
+parser.add_argument('--hotspot', default=os.path.join(root, 'lib/hotspot/hotspot'),
+                    help='HotSpot binary')
+parser.add_argument('--outdir', default='ltithermal',
+                    help='directory for HotSpot runs')
+args = parser.parse_args()
+
+config = spotfiles.ReadConfig(args.config)
+if int(config.get('leakage_used', 0)):
+    print('Leakage makes the HotSpot model nonlinear; set -leakage_used 0', file=sys.stderr)
+    sys.exit(1)
+args.config = os.path.abspath(args.config)
+args.floorplan = os.path.abspath(args.floorplan)
+if args.interval is None:
+    args.interval = float(config['sampling_intvl'])
+
+if args.mode == 'characterize':
+    if not os.path.exists(args.outdir):
+        os.makedirs(args.outdir)
+    Characterize(args, spotfiles.ReadFloorplan(args.floorplan), float(config['ambient']), float(config['init_temp']))
+    sys.exit(0)
+
+model = dict(np.load(args.model))
+model['names'] = list(model['names'])
+power = Powers(model, args.ptrace)
+temps, elapsed = Predict(args, model, power)
+
+if args.mode == 'predict':
+    out = sys.stdout if args.output == '-' else open(args.output, 'w')
+    WriteTemps(out, model, temps)
+    print('%d rows in %.3f s' % (len(temps), elapsed), file=sys.stderr)
+    sys.exit(0)
+
+# Validate block temperatures against HotSpot on the same trace and interval
+if len(model['shape']) == 2:
+    print('Validation compares block temperatures; use a block model', file=sys.stderr)
+    sys.exit(1)
+ttrace = args.ttrace
+hotspot_time = None
+if not ttrace:
+    if not os.path.exists(args.outdir):
+        os.makedirs(args.outdir)
+    ttrace = os.path.join(args.outdir, 'validate.ttrace')
+    start = time.time()
+    sproc.check_call(HotSpotArgs(args, os.path.abspath(args.ptrace), ttrace, args.interval,
+                                 float(config['init_temp'])).split(),
+                     stdout=open(os.path.join(args.outdir, 'validate.log'), 'w'), stderr=sproc.STDOUT)
+    hotspot_time = time.time() - start
+with open(ttrace, 'r') as fd:
+    names, rows = spotfiles.ReadPtrace(fd)
+reference = np.array(rows)
+n = min(len(reference), len(temps))
+print('%-24s %12s %12s' % ('block', 'max err (K)', 'rms err (K)'))
+for i, name in enumerate(names):
+    error = temps[:n, model['names'].index(name)] - reference[:n, i]
+    print('%-24s %12.4f %12.4f' % (name, np.abs(error).max(), np.sqrt((error**2).mean())))
+print('%d rows: LTI %s %.3f s' % (n, args.method, elapsed) +
+      (', HotSpot %.3f s (%.0fx)' % (hotspot_time, hotspot_time/max(elapsed, 1e-9)) if hotspot_time else ''))
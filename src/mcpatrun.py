@@ -0,0 +1,75 @@
+#!/usr/bin/python3
+import os
+import subprocess as sproc
+
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+mcpat_dir = os.path.join(root, 'lib/mcpat-riscv')
+
+
+def Translate(m5out, xml, template=None):
+    # GEM5ToMcPAT over the final dump in m5out
+    template = template or os.path.join(root, 'config/Penryn.xml')
+    sproc.check_call(['python2.7', os.path.join(mcpat_dir, 'GEM5ToMcPAT.py'), '--quiet',
+                      '--out', xml,
+                      os.path.join(m5out, 'stats.txt'),
+                      os.path.join(m5out, 'config.json'),
+                      template])
+
+
+def RunMcPAT(m5out, workdir=None, template=None):
+    # One-shot GEM5ToMcPAT -> McPAT -> McPATToHotSpot over the final dump in m5out.
+    # Returns (block names, per-block watts) in floorplan order.
+    workdir = workdir or m5out
+    xml = os.path.join(workdir, 'mcpat.xml')
+    Translate(m5out, xml, template)
+    return RunXml(xml, workdir)
+
+
+def RunXml(xml, workdir):
+    # McPAT -> McPATToHotSpot over a translated McPAT input
+    out = os.path.join(workdir, 'mcpat.out')
+    ptrace = os.path.join(workdir, 'mcpat.ptrace')
+    with open(out, 'w') as fd:
+        sproc.check_call([os.path.join(mcpat_dir, 'mcpat'), '-infile', xml, '-print_level', '5'], stdout=fd)
+    sproc.check_call(['python2.7', os.path.join(mcpat_dir, 'McPATToHotSpot.py'), '-o', ptrace, out])
+    with open(ptrace, 'r') as fd:
+        names, rows = spotfiles.ReadPtrace(fd)
+    return names, rows[-1]
+
+
+class Worker:
+    # The -sim 1 McPAT -> McPATToHotSpot chain reclaim.py runs, kept alive in workdir and fed one
+    # McPAT input at a time the way GEM5ToMcPAT.py --sim feeds it: written to sim.xml, then renamed
+    # to the _sim.xml McPAT polls for.  The next input goes in only after the previous row is back,
+    # so McPAT never sees two.  Saves McPAT's and python2.7's start-up on every run.
+    def __init__(self, workdir):
+        self.workdir = workdir
+        self.names = None
+        self.hotspot = sproc.Popen(['python2.7', '-u', os.path.join(mcpat_dir, 'McPATToHotSpot.py'),
+                                    '-o', '/dev/stdout', '/dev/stdin'],
+                                   stdin=sproc.PIPE, stdout=sproc.PIPE, universal_newlines=True,
+                                   stderr=open(os.path.join(workdir, 'mcpat-hotspot.err'), 'w'))
+        self.mcpat = sproc.Popen([os.path.join(mcpat_dir, 'mcpat'), '-infile', '_sim.xml',
+                                  '-print_level', '5', '-is_tdp', '0', '-sim', '1', '-out_switch', '0'],
+                                 cwd=workdir, stdout=self.hotspot.stdin,
+                                 stderr=open(os.path.join(workdir, 'mcpat.err'), 'w'))
+        self.hotspot.stdin.close()
+
+    def Run(self, xml):
+        # Returns (block names, per-block watts) for one McPAT input given as text
+        with open(os.path.join(self.workdir, 'sim.xml'), 'w') as fd:
+            fd.write(xml)
+        os.rename(os.path.join(self.workdir, 'sim.xml'), os.path.join(self.workdir, '_sim.xml'))
+        if self.names is None:
+            self.names = self.hotspot.stdout.readline().split()
+        line = self.hotspot.stdout.readline()
+        if not line:
+            raise RuntimeError('McPAT in %s exited; see mcpat.err there' % self.workdir)
+        return self.names, [float(value) for value in line.split()]
+
+    def Close(self):
+        self.mcpat.terminate()
+        self.mcpat.wait()
+        self.hotspot.wait()
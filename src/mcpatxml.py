@@ -0,0 +1,161 @@
+#!/usr/bin/python3
+import argparse
+import json
+import re
+import sys
+
+import gem5stats
+
+attribute_re = re.compile(r'(<(param|stat)\s+name="([^"]*)"\s+value=")([^"]*)("(?:\s+interval_value="([^"]*)")?)')
+component_re = re.compile(r'<component\s+id="([^"]*)"|</component>')
+stat_re = re.compile(r'stats\.([\w.:]+)')
+config_re = re.compile(r'config\.([\w.:]+)')
+
+
+def ConfigValue(config, path):
+    # Walk a dotted path through gem5's config.json; numeric parts index lists and a list
+    # without an index stands for its first element, as with mem_ctrls
+    value = config
+    for part in path.split('.'):
+        if isinstance(value, list) and not part.isdigit():
+            value = value[0] if value else {}
+        if part.isdigit() and isinstance(value, list):
+            value = value[int(part)]
+        elif isinstance(value, dict) and part in value:
+            value = value[part]
+        else:
+            print('mcpatxml: %s does not exist in config' % path, file=sys.stderr)
+            return 0
+    return value
+
+
+def Split(value):
+    # Comma-separated McPAT list items, leaving commas inside brackets and quotes alone
+    parts = ['']
+    depth = 0
+    quote = None
+    for c in value:
+        if quote:
+            quote = None if c == quote else quote
+        elif c in '\'"':
+            quote = c
+        elif c in '([{':
+            depth += 1
+        elif c in ')]}':
+            depth -= 1
+        elif c == ',' and depth == 0:
+            parts.append('')
+            continue
+        parts[-1] += c
+    return parts
+
+
+def Evaluate(part):
+    # A substituted config expression; anything that isn't one (a string such as a memory type) stays literal
+    try:
+        return str(eval(part))
+    except Exception:
+        return part
+
+
+class Translator:
+    # GEM5ToMcPAT with the template parsed once.  config.json parameters are substituted at load,
+    # and every stat expression, including a param's interval_value, is compiled into one function
+    # over a vector of the stats it reads, so an interval costs one pass over that vector and a
+    # string join (about 0.2-0.25 ms for Penryn.xml).
+    def __init__(self, template, config):
+        with open(template, 'r') as fd:
+            text = fd.read()
+        with open(config, 'r') as fd:
+            config = json.load(fd)
+        self.names = []
+        index = {}
+
+        def Slot(match):
+            name = match.group(1)
+            if name not in index:
+                index[name] = len(self.names)
+                self.names.append(name)
+            return 'v[%d]' % index[name]
+
+        # Split the template into literal text around the stat values; track the component each
+        # value sits in for the in-memory form
+        self.fragments = []
+        self.paths = []
+        expressions = []
+        components = []
+        literal = []
+        position = 0
+        for match in re.finditer('%s|%s' % (component_re.pattern, attribute_re.pattern), text):
+            if match.group(0).startswith('</component'):
+                components.pop()
+                continue
+            if match.group(0).startswith('<component'):
+                components.append(match.group(1))
+                continue
+            prefix, name, value = match.group(2, 4, 5)
+            # A per-interval expression (such as a DVFS domain's clock) takes the place of the static value
+            value = match.group(7) or value
+            if 'config.' in value:
+                value = config_re.sub(lambda m: str(ConfigValue(config, m.group(1))), value)
+                value = ','.join(Evaluate(part) for part in Split(value))
+            literal.append(text[position:match.start()] + prefix)
+            if 'stats.' in value:
+                self.fragments.append(''.join(literal))
+                self.paths.append('%s.%s' % (components[-1] if components else 'root', name))
+                expressions.append([stat_re.sub(Slot, part) for part in Split(value)])
+                literal = []
+            else:
+                literal.append(value)
+            literal.append(match.group(6))
+            position = match.end()
+        self.fragments.append(''.join(literal) + text[position:])
+
+        # One function returning every stat value; comma lists become tuples
+        self.widths = [len(parts) for parts in expressions]
+        source = 'def Values(v):\n    return (%s,)\n' % ', '.join(part for parts in expressions for part in parts)
+        scope = {}
+        exec(compile(source, template, 'exec'), scope)
+        self.evaluate = scope['Values'] if expressions else (lambda v: ())
+
+    def Values(self, dump):
+        # Stat values in template order, missing stats reading as zero like GEM5ToMcPAT
+        return self.evaluate([dump.get(name, 0.0) for name in self.names])
+
+    def Stats(self, dump):
+        # The same values keyed by component id and stat name, for callers that skip the xml
+        values = iter(self.Values(dump))
+        return dict((path, [next(values) for i in range(width)])
+                    for path, width in zip(self.paths, self.widths))
+
+    def Render(self, dump):
+        values = iter(self.Values(dump))
+        out = [self.fragments[0]]
+        for width, fragment in zip(self.widths, self.fragments[1:]):
+            out.append(','.join('%.12g' % next(values) for i in range(width)))
+            out.append(fragment)
+        return ''.join(out)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Translate gem5 stats into a McPAT input, like GEM5ToMcPAT.py with the template compiled once.')
+    parser.add_argument('stats',
+                        help='gem5 stats.txt')
+    parser.add_argument('config',
+                        help='gem5 config.json')
+    parser.add_argument('template',
+                        help='McPAT template')
+    parser.add_argument('--dump', type=int, default=-1,
+                        help='dump to translate, counting from 0 (default: the last)')
+    parser.add_argument('-o', '--out', default='mcpat-out.xml',
+                        help='output McPAT input file')
+    args = parser.parse_args()
+
+    translator = Translator(args.template, args.config)
+    with open(args.stats, 'r') as fd:
+        dumps = list(gem5stats.ReadDumps(fd))
+    if not dumps:
+        print('mcpatxml: no dumps in %s' % args.stats, file=sys.stderr)
+        sys.exit(1)
+    with open(args.out, 'w') as fd:
+        fd.write(translator.Render(dumps[args.dump]))
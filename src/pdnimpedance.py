@@ -0,0 +1,84 @@
+#!/usr/bin/python3
+
+import multiprocessing as mp
+import os
+import sys
+import time
+
+import numpy as np
+import scipy.sparse.linalg
+
+import pdnmodel
+import spotfiles
+
+network = None
+
+
+def Impedance(f):
+    # Self-impedance seen by every block at one frequency: diag(B^T (A + j2pifE)^-1 B), with one
+    # sparse factorization shared by all blocks
+    s = 2j*np.pi*f
+    lu = scipy.sparse.linalg.splu((network['A'] + s*network['E']).tocsc())
+    return np.abs(np.einsum('nb,nb->b', network['B'], lu.solve(network['B'].astype(complex))))
+
+
+def Peaks(z, count):
+    # Indices of the largest local maxima of one block's |Z(f)|
+    inner = np.flatnonzero((z[1:-1] > z[:-2]) & (z[1:-1] >= z[2:])) + 1
+    return sorted(inner, key=lambda i: -z[i])[:count]
+
+
+if __name__ == '__main__':
+    parser = pdnmodel.Parser('PDN impedance profile Z(f) at every floorplan block, with its resonance peaks.')
+    parser.add_argument('--fmin', type=float, default=1e5,
+                        help='lowest frequency in Hz')
+    parser.add_argument('--fmax', type=float, default=1e10,
+                        help='highest frequency in Hz')
+    parser.add_argument('--points', type=int, default=200,
+                        help='log-spaced frequency points')
+    parser.add_argument('--peaks', type=int, default=2,
+                        help='resonance peaks reported per block')
+    parser.add_argument('--reduced', action='store_true',
+                        help='evaluate the PRIMA-reduced model (as pdnmodel.py builds it) instead of the full network')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                        help='frequencies solved concurrently')
+    parser.add_argument('-o', '--output', default=None,
+                        help='write |Z| per frequency and block to this file')
+    args = parser.parse_args()
+
+    start = time.time()
+    config = spotfiles.ReadConfig(args.config)
+    network = pdnmodel.Network(config, spotfiles.ReadFloorplan(args.floorplan), args.sheet_r)
+    freqs = np.logspace(np.log10(args.fmin), np.log10(args.fmax), args.points)
+    if args.reduced:
+        rom = pdnmodel.Reduce(network, [0.0, 2*np.pi*1e8, 2*np.pi*1e9], 2)
+        z = np.array([np.abs(np.einsum('nb,nb->b', rom['B'], np.linalg.solve(rom['A'] + 2j*np.pi*f*rom['E'], rom['B'])))
+                      for f in freqs])
+        # The reduction matches moments at s = 0, so its DC resistance is exact
+        dc = np.abs(np.einsum('nb,nb->b', rom['B'], np.linalg.solve(rom['A'], rom['B'])))
+    else:
+        # Workers fork after the network is built and share it read-only
+        pool = mp.Pool(args.jobs)
+        z = np.array(pool.map(Impedance, freqs))
+        pool.close()
+        dc = Impedance(0.0)
+    names = network['names']
+
+    if args.output:
+        with open(args.output, 'w') as fd:
+            fd.write('freq\t' + '\t'.join(names) + '\n')
+            for f, row in zip(freqs, z):
+                fd.write('%g\t' % f + '\t'.join('%g' % v for v in row) + '\n')
+
+    clock = float(config['proc_clock_freq'])
+    print('%dx%d grid, %d pad pairs, %d frequencies in %.1f s' %
+          (network['rows'], network['cols'], network['pads'], len(freqs), time.time() - start))
+    print('%-24s %12s %14s %10s' % ('block', 'DC (mohm)', 'peak (Hz)', '|Z| (mohm)'))
+    for j, name in enumerate(names):
+        for k, i in enumerate(Peaks(z[:, j], args.peaks)):
+            print('%-24s %12s %14.4g %10.3f' % (name if k == 0 else '', '%.3f' % (1e3*dc[j]) if k == 0 else '',
+                                                 freqs[i], 1e3*z[i, j]))
+    worst = np.unravel_index(z.argmax(), z.shape)
+    print('worst: %s at %.4g Hz (%.1f cycles), %.3f mohm' %
+          (names[worst[1]], freqs[worst[0]], clock/freqs[worst[0]], 1e3*z[worst]))
+    sys.exit(0)
@@ -0,0 +1,278 @@
+#!/usr/bin/python3
+
+import argparse
+import os
+import subprocess as sproc
+import sys
+import time
+
+import numpy as np
+import scipy.linalg
+import scipy.signal
+import scipy.sparse as sparse
+import scipy.sparse.linalg
+
+import simmanager as sim
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+def Network(config, blocks, sheet_r):
+    # Loop (Vdd plus Gnd) model of the VoltSpot PDN as E x' = -A x + B u, where x holds the
+    # on-chip and package node droops, the branch currents and the package capacitor voltage,
+    # and u the block currents.  The Vdd and Gnd nets are symmetric, so the grid and pad
+    # impedances are doubled and each Vdd pad is paired with a Gnd pad.
+    width, height = spotfiles.ChipSize(blocks)
+    pitch = float(config['PDN_padpitch'])
+    intv = int(config.get('PDN_grid_intv', 1))
+    pad_cols, pad_rows = int(width/pitch), int(height/pitch)
+    cols, rows = pad_cols*intv, pad_rows*intv
+    grid = rows*cols
+    dx, dy = width/cols, height/rows
+    lc = int(config.get('PDN_pkgLC', 1))
+    tiny = 1e-18
+    pkg = grid
+
+    # Branches: (from node, to node or None for the supply, R, L)
+    branches = []
+    for pr in range(pad_rows):
+        for pc in range(pad_cols):
+            if (pr + pc) % 2 == 0:
+                node = (pr*intv + intv//2)*cols + pc*intv + intv//2
+                branches.append((node, pkg, 2*float(config['PDN_padR']), 2*float(config['PDN_padL']) if lc else tiny))
+    branches.append((pkg, None, float(config['PDN_pkg_sR']), float(config['PDN_pkg_sL']) if lc else tiny))
+    shunt = None
+    if lc:
+        shunt = len(branches)
+        branches.append((pkg, None, float(config['PDN_pkg_pR']), float(config['PDN_pkg_pL'])))
+
+    n = grid + 1
+    m = len(branches)
+    size = n + m + (1 if lc else 0)
+
+    # Grid conductances
+    gh = 1/(2*sheet_r*dx/dy)
+    gv = 1/(2*sheet_r*dy/dx)
+    index = np.arange(grid).reshape(rows, cols)
+    left, right = index[:, :-1].ravel(), index[:, 1:].ravel()
+    below, above = index[:-1, :].ravel(), index[1:, :].ravel()
+    a, b = np.concatenate([left, below]), np.concatenate([right, above])
+    g = np.concatenate([np.full(len(left), gh), np.full(len(below), gv)])
+    entries = [(a, a, g), (b, b, g), (a, b, -g), (b, a, -g)]
+
+    # Branch incidence: the node rows get +i at the from node, -i at the to node, and the branch
+    # rows the transpose with the opposite sign, which keeps A + A^T positive semidefinite
+    for k, (src, dst, r, l) in enumerate(branches):
+        entries.append((np.array([src, n + k, n + k]), np.array([n + k, src, n + k]), np.array([1.0, -1.0, r])))
+        if dst is not None:
+            entries.append((np.array([dst, n + k]), np.array([n + k, dst]), np.array([-1.0, 1.0])))
+    if lc:
+        entries.append((np.array([n + shunt, size - 1]), np.array([size - 1, n + shunt]), np.array([1.0, -1.0])))
+    A = sparse.coo_matrix((np.concatenate([e[2] for e in entries]),
+                           (np.concatenate([e[0] for e in entries]), np.concatenate([e[1] for e in entries]))),
+                          shape=(size, size)).tocsc()
+
+    # Decap spread evenly over the grid; the package node itself has none
+    area = width*height*1e6     # mm^2
+    c_node = float(config['PDN_decap_dense'])*1e-9*area*float(config['PDN_decap_ratio'])/grid
+    diagonal = np.concatenate([np.full(grid, c_node), [0.0], [br[3] for br in branches],
+                               [float(config['PDN_pkg_C'])] if lc else []])
+    E = sparse.diags(diagonal).tocsc()
+
+    # Each block's current is drawn evenly from the grid nodes inside it, so B^T x is the
+    # block's average droop
+    x = (np.arange(cols) + 0.5)*dx
+    y = (np.arange(rows) + 0.5)*dy
+    B = np.zeros((size, len(blocks)))
+    for j, (name, w, h, left_x, bottom_y) in enumerate(blocks):
+        inside = np.outer((y >= bottom_y) & (y < bottom_y + h), (x >= left_x) & (x < left_x + w)).ravel()
+        if not inside.any():
+            inside = np.zeros(grid, dtype=bool)
+            inside[int(min((bottom_y + h/2)/dy, rows - 1))*cols + int(min((left_x + w/2)/dx, cols - 1))] = True
+        B[:grid, j] = inside/float(inside.sum())
+    return {'E': E, 'A': A, 'B': B, 'names': [b[0] for b in blocks],
+            'rows': rows, 'cols': cols, 'pads': len(branches) - (2 if lc else 1)}
+
+
+def Reduce(network, points, moments):
+    # PRIMA: a block Krylov basis of (A + s0 E)^-1 E around each expansion point, then a
+    # congruence transform, which keeps the reduced model passive
+    E, A, B = network['E'], network['A'], network['B']
+    basis = []
+    for s0 in points:
+        lu = sparse.linalg.splu((A + s0*E).tocsc())
+        block = lu.solve(B)
+        for _ in range(moments):
+            basis.append(block)
+            block = lu.solve(E.dot(block))
+    V = scipy.linalg.orth(np.hstack(basis))
+    return {'E': V.T.dot(E.dot(V)), 'A': V.T.dot(A.dot(V)), 'B': V.T.dot(B), 'names': network['names']}
+
+
+def Droop(rom, currents, dt, substeps, state=None):
+    # Backward Euler at dt with each current row held for substeps steps, run in the modal
+    # basis so every mode is a first-order recursion over the whole chunk.  Returns per-row,
+    # per-block peak droop and the state to continue from.
+    E, A, B = rom['E'], rom['A'], rom['B']
+    if 'modes' not in rom or rom['dt'] != dt:
+        M = np.linalg.inv(E/dt + A)
+        poles, W = np.linalg.eig(M.dot(E/dt))
+        Winv = np.linalg.inv(W)
+        rom.update({'dt': dt, 'modes': (poles, Winv.dot(M.dot(B)), B.T.dot(W), Winv)})
+    poles, gain, output, Winv = rom['modes']
+    if state is None:
+        # Start from the DC operating point of the first row
+        state = Winv.dot(np.linalg.solve(A, B.dot(currents[0])))
+    drive = np.repeat(currents, substeps, axis=0).dot(gain.T)
+    z = np.empty(drive.shape, dtype=complex)
+    for j in range(len(poles)):
+        z[:, j], _ = scipy.signal.lfilter([1.0], [1.0, -poles[j]], drive[:, j], zi=[poles[j]*state[j]])
+    droop = z.dot(output.T).real
+    return droop.reshape(len(currents), substeps, -1).max(axis=1), z[-1]
+
+
+def Windows(flags, context, rows):
+    # Runs of flagged rows, widened by context rows on each side and merged where they touch
+    windows = []
+    for row in np.flatnonzero(flags):
+        start, stop = max(row - context, 0), min(row + context, rows - 1)
+        if windows and start <= windows[-1][1] + 1:
+            windows[-1][1] = max(windows[-1][1], stop)
+        else:
+            windows.append([start, stop])
+    return windows
+
+
+def Verify(args, windows):
+    # Full VoltSpot over each window of the original trace, a few at a time
+    sman = sim.SimManager()
+    pending = list(enumerate(windows))
+    running = {}
+    while pending or running:
+        while pending and len(running) < args.jobs:
+            i, (start, stop) = pending.pop(0)
+            outdir = os.path.join(args.outdir, 'window%d' % i)
+            if not os.path.exists(outdir):
+                os.makedirs(outdir)
+            voltspot_args = '%s -f %s -p %s -c %s -gridvol_file %s -PDN_ptrace_start %d -PDN_ptrace_stop %d' % \
+                (args.voltspot, args.floorplan, os.path.abspath(args.ptrace), args.config,
+                 os.path.join(outdir, 'voltspot.gridvol'), start + 1, stop + 1)
+            running[i] = sman.StartTool('window%d' % i, voltspot_args,
+                                        stdout=open(os.path.join(outdir, 'voltspot.log'), 'w'), stderr=sproc.STDOUT)
+        for i, proc in list(running.items()):
+            if proc.poll() is not None:
+                if proc.returncode != 0:
+                    print('VoltSpot failed for window %d (%d)' % (i, proc.returncode), file=sys.stderr)
+                del running[i]
+        time.sleep(0.5)
+
+
+def Load(filename):
+    data = np.load(filename)
+    return {'E': data['E'], 'A': data['A'], 'B': data['B'], 'names': list(data['names'])}
+
+
+def Currents(rom, filename, vdd):
+    # Block currents from a ptrace, in the model's block order
+    with open(filename, 'r') as fd:
+        names, rows = spotfiles.ReadPtrace(fd)
+    rows = np.array(rows)
+    currents = np.zeros((len(rows), len(rom['names'])))
+    for j, name in enumerate(rom['names']):
+        if name in names:
+            currents[:, j] = rows[:, names.index(name)]/vdd
+    return currents
+
+
+def Parser(description):
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('-c', '--config', default=os.path.join(root, 'config/voltspot.config'),
+                        help='VoltSpot config file')
+    parser.add_argument('-f', '--floorplan', default=os.path.join(root, 'config/penryn.flp'),
+                        help='floorplan file')
+    parser.add_argument('--sheet-r', type=float, default=0.01,
+                        help='effective sheet resistance of one net\'s on-chip grid in ohm/square')
+    return parser
+
+
+if __name__ == '__main__':
+    parser = Parser('Reduced-order PDN model: screen long power traces for droop and verify the worst windows with VoltSpot.')
+    parser.add_argument('mode', choices=['build', 'screen'],
+                        help='reduce the PDN network to a model file, or screen a ptrace with it')
+    parser.add_argument('-p', '--ptrace', default='ptrace.txt',
+                        help='power trace to screen')
+    parser.add_argument('-m', '--model', default='pdnmodel.npz',
+                        help='reduced model file')
+    parser.add_argument('--points', type=float, nargs='+', default=[0.0, 1e8, 1e9],
+                        help='PRIMA expansion frequencies in Hz')
+    parser.add_argument('--moments', type=int, default=2,
+                        help='block moments matched at each expansion point')
+    parser.add_argument('--margin', type=float, default=0.8,
+                        help='verify windows whose predicted droop reaches this fraction of the noise threshold')
+    parser.add_argument('--context', type=int, default=200,
+                        help='ptrace rows of lead-in and tail around each flagged row')
+    parser.add_argument('--chunk', type=int, default=100000,
+                        help='ptrace rows per screening chunk')
+    parser.add_argument('--no-verify', action='store_true',
+                        help='report the flagged windows without running VoltSpot')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                        help='VoltSpot windows to run concurrently')
+    parser.add_argument('--voltspot', default=os.path.join(root, 'lib/voltspot/bin/voltspot'),
+                        help='VoltSpot binary')
+    parser.add_argument('-o', '--outdir', default='pdnmodel',
+                        help='directory for per-window VoltSpot runs')
+    args = parser.parse_args()
+    args.config = os.path.abspath(args.config)
+    args.floorplan = os.path.abspath(args.floorplan)
+
+    config = spotfiles.ReadConfig(args.config)
+    vdd = float(config['vdd'])
+
+    if args.mode == 'build':
+        start = time.time()
+        network = Network(config, spotfiles.ReadFloorplan(args.floorplan), args.sheet_r)
+        rom = Reduce(network, [2*np.pi*f for f in args.points], args.moments)
+        np.savez(args.model, **rom)
+        print('%dx%d grid, %d pad pairs, %d states -> %d in %.1f s' %
+              (network['rows'], network['cols'], network['pads'], network['A'].shape[0], len(rom['A']), time.time() - start))
+        sys.exit(0)
+
+    rom = Load(args.model)
+    threshold = float(config.get('PDN_noise_th', 5))/100*vdd
+    substeps = int(float(config.get('ptrace_sampling_intvl', 1))*float(config.get('PDN_step_percycle', 1)))
+    dt = float(config.get('ptrace_sampling_intvl', 1))/float(config['proc_clock_freq'])/substeps
+    currents = Currents(rom, args.ptrace, vdd)
+
+    start = time.time()
+    peak = np.zeros(len(currents))
+    worst = np.zeros(len(rom['names']))
+    state = None
+    for first in range(0, len(currents), args.chunk):
+        droop, state = Droop(rom, currents[first:first + args.chunk], dt, substeps, state)
+        peak[first:first + len(droop)] = droop.max(axis=1)
+        worst = np.maximum(worst, droop.max(axis=0))
+    elapsed = time.time() - start
+    windows = Windows(peak >= args.margin*threshold, args.context, len(currents))
+    print('%d rows screened in %.2f s; peak predicted droop %.4f V (threshold %.4f V); %d windows to verify' %
+          (len(currents), elapsed, peak.max(), threshold, len(windows)))
+    print('%-24s %12s' % ('block', 'droop (V)'))
+    for name, droop in zip(rom['names'], worst):
+        print('%-24s %12.4f' % (name, droop))
+    if args.no_verify or not windows:
+        for start_row, stop_row in windows:
+            print('window %d-%d: predicted %.4f V' % (start_row, stop_row, peak[start_row:stop_row + 1].max()))
+        sys.exit(0)
+
+    if not os.path.exists(args.outdir):
+        os.makedirs(args.outdir)
+    Verify(args, windows)
+    print('%8s %8s %14s %14s %10s' % ('start', 'stop', 'predicted (V)', 'VoltSpot (V)', 'violation'))
+    for i, (start_row, stop_row) in enumerate(windows):
+        gridvol = os.path.join(args.outdir, 'window%d' % i, 'voltspot.gridvol')
+        actual = float('nan')
+        if os.path.exists(gridvol):
+            with open(gridvol, 'r') as fd:
+                actual = spotfiles.GridDroop(fd, vdd)[0]
+        print('%8d %8d %14.4f %14.4f %10s' % (start_row, stop_row, peak[start_row:stop_row + 1].max(), actual,
+                                               'yes' if actual >= threshold else 'no'))
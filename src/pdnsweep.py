@@ -0,0 +1,123 @@
+#!/usr/bin/python3
+
+import argparse
+import math
+import os
+import subprocess as sproc
+import sys
+import threading
+import time
+
+import simmanager as sim
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+def Watch(fifo, result, threshold, vdd):
+    # Reduce a grid voltage stream as VoltSpot writes it, so no per-step maps reach the disk
+    with open(fifo, 'r') as fd:
+        result['droop'], result['violations'] = spotfiles.GridDroop(fd, vdd, threshold)
+
+
+def WatchPads(fifo, result):
+    current = 0.0
+    with open(fifo, 'r') as fd:
+        for frame in spotfiles.ReadGridFrames(fd):
+            current = max(current, max(max(abs(v) for v in row) for row in frame))
+    result['pad_current'] = current
+
+
+def Release(fifo, thread):
+    # Unblock a reader whose writer never opened the FIFO
+    if thread.is_alive():
+        try:
+            os.close(os.open(fifo, os.O_WRONLY | os.O_NONBLOCK))
+        except OSError:
+            pass
+    thread.join()
+
+
+parser = argparse.ArgumentParser(description='Sweep PDN pads, decap and package parameters over one shared power trace.')
+parser.add_argument('ptrace',
+                    help='recorded power trace')
+parser.add_argument('-s', '--sweep', action='append', default=[],
+                    metavar='NAME=V1,V2,...', help='VoltSpot parameter and values to sweep (repeat for a cross product)')
+parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                    help='VoltSpot runs to start concurrently')
+parser.add_argument('-c', '--config', default=os.path.join(root, 'config/voltspot.config'),
+                    help='base VoltSpot config file')
+parser.add_argument('-f', '--floorplan', default=os.path.join(root, 'config/penryn.flp'),
+                    help='floorplan file')
+parser.add_argument('--voltspot', default=os.path.join(root, 'lib/voltspot/bin/voltspot'),
+                    help='VoltSpot binary')
+parser.add_argument('-o', '--outdir', default='pdnsweep',
+                    help='directory for per-configuration logs')
+args = parser.parse_args()
+
+outdir = os.path.abspath(args.outdir)
+if not os.path.exists(outdir):
+    os.makedirs(outdir)
+base = spotfiles.ReadConfig(args.config)
+
+# Read the trace once; every configuration streams the same in-memory text
+with open(args.ptrace, 'r') as fd:
+    data = ''.join(line for line in fd if line.strip()).encode()
+
+points = spotfiles.ParseSweep(args.sweep)
+sman = sim.SimManager()
+pending = list(enumerate(points))
+running = {}
+results = {}
+start = time.time()
+while pending or running:
+    while pending and len(running) < args.jobs:
+        i, point = pending.pop(0)
+        config = dict(base, **point)
+        vdd = float(config['vdd'])
+        threshold = float(config.get('PDN_noise_th', 5))/100*vdd
+        gridvol = os.path.join(outdir, 'config%d.gridvol' % i)
+        padcur = os.path.join(outdir, 'config%d.padcur' % i)
+        for fifo in (gridvol, padcur):
+            if os.path.exists(fifo):
+                os.remove(fifo)
+            os.mkfifo(fifo)
+        results[i] = {}
+        watchers = [threading.Thread(target=Watch, args=(gridvol, results[i], threshold, vdd)),
+                    threading.Thread(target=WatchPads, args=(padcur, results[i]))]
+        for watcher in watchers:
+            watcher.start()
+        voltspot_args = '%s -f %s -p /dev/stdin -c %s -v /dev/stdout -gridvol_file %s -padcur_file %s ' \
+            '-PDN_ptrace_start 1 -PDN_ptrace_stop 999999999' % \
+            (args.voltspot, args.floorplan, args.config, gridvol, padcur)
+        voltspot_args += ''.join(' -%s %s' % item for item in point.items())
+        proc = sman.StartTool('config%d' % i, voltspot_args, stdin=sproc.PIPE,
+                              stdout=open(os.path.join(outdir, 'config%d.log' % i), 'w'), stderr=sproc.STDOUT)
+        feeder = threading.Thread(target=spotfiles.Feed, args=(proc, data))
+        feeder.start()
+        running[i] = (proc, feeder, watchers, (gridvol, padcur))
+    for i, (proc, feeder, watchers, fifos) in list(running.items()):
+        if proc.poll() is not None:
+            feeder.join()
+            for fifo, watcher in zip(fifos, watchers):
+                Release(fifo, watcher)
+                os.remove(fifo)
+            if proc.returncode != 0:
+                print('VoltSpot failed for config%d (%s)' % (i, spotfiles.Label(points[i])), file=sys.stderr)
+                del results[i]
+            del running[i]
+    time.sleep(0.5)
+print('%d configurations in %.1f s' % (len(points), time.time() - start))
+
+# Pad current density against the electromigration limit of each configuration
+for i, result in results.items():
+    config = dict(base, **points[i])
+    area = math.pi*(float(config['PDN_padD'])/2)**2
+    result['density'] = result.get('pad_current', 0.0)/area/float(config['PDN_cur_dense'])
+
+print('%8s %10s %10s %12s  %s' % ('config', 'droop (V)', 'violations', 'pad J/limit', 'parameters'))
+for i in sorted(results, key=lambda i: (results[i].get('droop', 0.0), results[i].get('violations', 0),
+                                        results[i]['density'])):
+    result = results[i]
+    print('%8s %10.4f %10d %12.3f  %s' % ('config%d' % i, result.get('droop', float('nan')), result.get('violations', 0),
+                                          result['density'], spotfiles.Label(points[i])))
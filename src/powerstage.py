@@ -0,0 +1,275 @@
+#!/usr/bin/python3
+
+import argparse
+import math
+import os
+import queue
+import re
+import sys
+import time
+from collections import OrderedDict, deque
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+import gem5stats
+import mcpatrun
+import mcpatxml
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+def TemplateStats(template):
+    # gem5 stats the McPAT template reads; the rest of a dump cannot change the power
+    with open(template, 'r') as fd:
+        return sorted(set(re.findall(r"stats\.([\w.:]+)", fd.read())))
+
+
+def Quantize(value, tolerance):
+    # Log buckets of relative width tolerance, so small and large counters get the same slack
+    if value == 0:
+        return None
+    return (value > 0, int(round(math.log(abs(value))/math.log1p(tolerance))))
+
+
+class Memo:
+    # LRU map from quantized activity vectors to McPAT block power
+    def __init__(self, names, tolerance, size):
+        self.names = names
+        self.tolerance = tolerance
+        self.size = size
+        self.entries = OrderedDict()
+        self.hits = 0
+        self.misses = 0
+
+    def Key(self, dump):
+        if self.tolerance < 0:
+            return None
+        return tuple(Quantize(dump.get(name, 0.0), self.tolerance) for name in self.names)
+
+    def Get(self, key):
+        if self.tolerance < 0 or key not in self.entries:
+            self.misses += 1
+            return None
+        self.hits += 1
+        self.entries.move_to_end(key)
+        return self.entries[key]
+
+    def Put(self, key, power):
+        if self.tolerance < 0:
+            return
+        self.entries[key] = power
+        if len(self.entries) > self.size:
+            self.entries.popitem(last=False)
+
+
+class Surrogate:
+    # Per-block power linear in the template's activity counters, ridge-fitted to the most recent
+    # McPAT results.  Counters are scaled by their largest magnitude seen so far so one ridge
+    # weight suits them all.
+    def __init__(self, names, window, ridge):
+        self.names = names
+        self.window = window
+        self.ridge = ridge
+        self.samples = []
+        self.scale = np.ones(len(names))
+        self.coefficients = None
+
+    def Features(self, dump):
+        return np.array([dump.get(name, 0.0) for name in self.names])
+
+    def Predict(self, features):
+        return np.append(features/self.scale, 1.0).dot(self.coefficients)
+
+    def Add(self, features, power):
+        self.samples = (self.samples + [(features, np.array(power))])[-self.window:]
+        self.scale = np.maximum(self.scale, np.abs(features))
+        X = np.array([np.append(f/self.scale, 1.0) for f, p in self.samples])
+        Y = np.array([p for f, p in self.samples])
+        penalty = self.ridge*np.eye(X.shape[1])
+        penalty[-1, -1] = 0.0
+        self.coefficients = np.linalg.solve(X.T.dot(X) + penalty, X.T.dot(Y))
+
+
+def Evaluate(dump, m5out, workdir, template, worker):
+    # McPAT over a single dump from its own directory next to gem5's config.json, through the
+    # directory's persistent worker or, without one, one-shot
+    xml = os.path.join(workdir, 'mcpat.xml')
+    if translator:
+        with open(xml, 'w') as fd:
+            fd.write(translator.Render(dump))
+    else:
+        with open(os.path.join(workdir, 'stats.txt'), 'w') as fd:
+            gem5stats.WriteDump(fd, dump)
+        config = os.path.join(workdir, 'config.json')
+        if not os.path.exists(config):
+            os.symlink(os.path.abspath(os.path.join(m5out, 'config.json')), config)
+        mcpatrun.Translate(workdir, xml, template)
+    if worker is None:
+        return mcpatrun.RunXml(xml, workdir)
+    with open(xml, 'r') as fd:
+        return worker.Run(fd.read())
+
+
+parser = argparse.ArgumentParser(description='Per-interval power from a gem5 stats stream, with McPAT results memoized on quantized activity.')
+parser.add_argument('stats', nargs='?', default='/dev/stdin',
+                    help='gem5 stats stream')
+parser.add_argument('--m5out', default='m5out',
+                    help='gem5 output directory holding config.json')
+parser.add_argument('--template', default=os.path.join(root, 'config/Penryn.xml'),
+                    help='McPAT template')
+parser.add_argument('--memo-tol', type=float, default=0.01,
+                    help='relative tolerance of the activity quantization; negative disables memoization')
+parser.add_argument('--memo-size', type=int, default=4096,
+                    help='most memoized intervals kept')
+parser.add_argument('--report', type=int, default=1000,
+                    help='print memo statistics to stderr every this many intervals')
+parser.add_argument('--surrogate', type=int, default=0,
+                    metavar='N', help='run McPAT only every Nth interval and estimate the rest with a linear model refitted on those runs')
+parser.add_argument('--surrogate-window', type=int, default=256,
+                    help='most recent McPAT intervals the surrogate is fitted to')
+parser.add_argument('--surrogate-warmup', type=int, default=16,
+                    help='intervals that always run McPAT before the surrogate is used')
+parser.add_argument('--surrogate-tol', type=float, default=0.1,
+                    help='relative total-power error of the surrogate above which every interval runs McPAT until a McPAT interval is predicted within it again')
+parser.add_argument('--ridge', type=float, default=1e-3,
+                    help='ridge regularization of the surrogate fit')
+parser.add_argument('--error', default=None,
+                    help='write the surrogate\'s error at every McPAT interval to this file')
+parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                    help='McPAT runs in flight at once')
+parser.add_argument('--window', type=int, default=64,
+                    help='most intervals buffered for reordering; reading stalls when the oldest is still running')
+parser.add_argument('--gem5tomcpat', action='store_true',
+                    help='translate each interval with GEM5ToMcPAT.py instead of the template compiled once in-process')
+parser.add_argument('--one-shot', action='store_true',
+                    help='start McPAT and McPATToHotSpot for every run instead of keeping a -sim 1 pair per job')
+parser.add_argument('-o', '--output', default='/dev/stdout',
+                    help='output ptrace')
+parser.add_argument('--workdir', default=None,
+                    help='scratch directory for McPAT runs (default: M5OUT/powerstage)')
+args = parser.parse_args()
+args.window = max(args.window, args.jobs)
+
+workdir = args.workdir or os.path.join(args.m5out, 'powerstage')
+if not os.path.exists(workdir):
+    os.makedirs(workdir)
+stat_names = TemplateStats(args.template)
+translator = None if args.gem5tomcpat else mcpatxml.Translator(args.template, os.path.join(args.m5out, 'config.json'))
+memo = Memo(stat_names, args.memo_tol, args.memo_size)
+surrogate = Surrogate(stat_names, args.surrogate_window, args.ridge) if args.surrogate > 0 else None
+error_fd = open(args.error, 'w') if args.error else None
+if error_fd:
+    error_fd.write('interval\tmax_abs_err_W\ttotal_rel_err\n')
+mcpat_time = 0.0
+estimates = 0
+worst_error = 0.0
+fallback = False
+fallbacks = 0
+wasted = 0
+emitted = 0
+header = None
+
+
+def Report():
+    total = memo.hits + memo.misses
+    print('powerstage: %d intervals, %d hits (%.1f%%), %d McPAT runs in %.1f s' %
+          (total, memo.hits, 100.0*memo.hits/total if total else 0.0, memo.misses - estimates, mcpat_time) +
+          (', %d surrogate estimates (worst total error %.2f%%, %d fallbacks to McPAT)' % (estimates, 100*worst_error, fallbacks) if surrogate else '') +
+          (', %d early runs discarded' % wasted if wasted else ''),
+          file=sys.stderr)
+
+
+def Estimated(interval):
+    # Whether a memo miss at this interval is left to the surrogate
+    return surrogate is not None and not fallback and \
+        interval >= args.surrogate_warmup and interval % args.surrogate != 0
+
+
+def Timed(dump):
+    # Runs on a pool thread, or on the main thread for a McPAT run that was not started early.
+    # Each run borrows a scratch directory, and its McPAT worker, that no other run is using.
+    rundir, worker = slots.get()
+    try:
+        start = time.time()
+        result = Evaluate(dump, args.m5out, rundir, args.template, worker)
+        return result, time.time() - start
+    finally:
+        slots.put((rundir, worker))
+
+
+def Emit(entry, out):
+    # Write one interval's row.  The memo lookup, the surrogate estimate and the fit are decided
+    # here, in interval order, so the output does not depend on --jobs or --window; a McPAT run
+    # started early for an interval that turns out to be a hit or an estimate is discarded.
+    global header, mcpat_time, estimates, worst_error, wasted, fallback, fallbacks, emitted
+    interval, dump, key, future = entry
+    if future is not None and inflight.get(key) is future:
+        del inflight[key]
+    result = memo.Get(key)
+    if result is None and surrogate and surrogate.coefficients is not None and Estimated(interval):
+        result = (header, surrogate.Predict(surrogate.Features(dump)))
+        estimates += 1
+    if result is None:
+        result, elapsed = future.result() if future is not None else Timed(dump)
+        mcpat_time += elapsed
+        memo.Put(key, result)
+        if surrogate:
+            features = surrogate.Features(dump)
+            # Score the current fit on this interval before it joins the fit
+            if surrogate.coefficients is not None:
+                error = surrogate.Predict(features) - np.array(result[1])
+                total_error = abs(error.sum())/max(abs(sum(result[1])), 1e-12)
+                worst_error = max(worst_error, total_error)
+                # Stop trusting the fit while its last measured error is out of tolerance
+                fallbacks += total_error > args.surrogate_tol and not fallback
+                fallback = total_error > args.surrogate_tol
+                if error_fd:
+                    error_fd.write('%d\t%g\t%g\n' % (interval, np.abs(error).max(), total_error))
+                    error_fd.flush()
+            surrogate.Add(features, result[1])
+    elif future is not None:
+        future.cancel()
+        wasted += 1
+    names, power = result
+    if header is None:
+        header = names
+        out.write('\t'.join(names) + '\n')
+    out.write('\t'.join('%g' % p for p in power) + '\n')
+    out.flush()
+    emitted += 1
+    if args.report and emitted % args.report == 0:
+        Report()
+
+
+pool = ThreadPoolExecutor(max_workers=args.jobs)
+slots = queue.Queue()
+for slot in range(args.jobs + 1):
+    rundir = os.path.join(workdir, 'slot%d' % slot)
+    if not os.path.exists(rundir):
+        os.makedirs(rundir)
+    slots.put((rundir, None if args.one_shot else mcpatrun.Worker(rundir)))
+pending = deque()
+inflight = {}
+with open(args.stats, 'r') as infd, open(args.output, 'w') as out:
+    for interval, dump in enumerate(gem5stats.ReadDumps(infd)):
+        key = memo.Key(dump)
+        future = None
+        # Start McPAT early unless the interval looks like a memo hit (its activity is memoized
+        # or already running) or a surrogate estimate by the time it is emitted
+        if not (key is not None and (key in memo.entries or key in inflight)) and not Estimated(interval):
+            future = pool.submit(Timed, dump)
+            if key is not None:
+                inflight[key] = future
+        pending.append((interval, dump, key, future))
+        # Emit whatever is finished at the head; once the window is full, wait for the head
+        while pending and (pending[0][3] is None or pending[0][3].done() or len(pending) >= args.window):
+            Emit(pending.popleft(), out)
+    while pending:
+        Emit(pending.popleft(), out)
+pool.shutdown()
+while not slots.empty():
+    rundir, worker = slots.get()
+    if worker:
+        worker.Close()
+Report()
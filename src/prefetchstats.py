@@ -0,0 +1,49 @@
+#!/usr/bin/python3
+
+import argparse
+import re
+
+import gem5stats
+
+issuedPattern = re.compile(r"^(system\.(?:cpu\d*\.[id]cache|l2\d*))\.HardPFReq_mshr_misses::total$")
+
+
+def PrefetchStats(dump):
+    # Per cache with a prefetcher: prefetches it sent below, how many were evicted before a
+    # demand touched them, and the demand misses left over.  A prefetched line still resident
+    # at the end of the dump counts as useful.
+    caches = {}
+    for name, issued in dump.items():
+        match = issuedPattern.match(name)
+        if match and issued:
+            cache = match.group(1)
+            unused = dump.get(cache + '.unused_prefetches', 0.0)
+            useful = max(issued - unused, 0.0)
+            misses = dump.get(cache + '.demand_mshr_misses::total', 0.0)
+            caches[cache] = {'issued': issued,
+                             'useful': useful,
+                             'accuracy': useful/issued,
+                             'coverage': useful/(useful + misses) if useful + misses else 0.0}
+    return caches
+
+
+parser = argparse.ArgumentParser(description='Report prefetch accuracy and coverage from gem5 stats.')
+parser.add_argument('stats', nargs='?', default='m5out/stats.txt',
+                    help='gem5 stats file')
+parser.add_argument('-a', '--all', action='store_true',
+                    help='report every dump instead of summing them')
+args = parser.parse_args()
+
+with open(args.stats, 'r') as fd:
+    dumps = list(gem5stats.ReadDumps(fd))
+if not args.all:
+    total = {}
+    for dump in dumps:
+        for name, value in dump.items():
+            total[name] = total.get(name, 0.0) + value
+    dumps = [total]
+
+print('%5s %-24s %12s %12s %9s %9s' % ('dump', 'cache', 'issued', 'useful', 'accuracy', 'coverage'))
+for i, dump in enumerate(dumps):
+    for cache, s in sorted(PrefetchStats(dump).items()):
+        print('%5d %-24s %12d %12d %8.2f%% %8.2f%%' % (i, cache, s['issued'], s['useful'], 100*s['accuracy'], 100*s['coverage']))
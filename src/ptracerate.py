@@ -0,0 +1,47 @@
+#!/usr/bin/python3
+
+import argparse
+import os
+
+parser = argparse.ArgumentParser(description='Pass a power trace through at full rate and as K-row averages for a slower consumer.')
+parser.add_argument('-i', '--input', default='/dev/stdin',
+                    help='input power trace')
+parser.add_argument('-v', '--full', default='/dev/stdout',
+                    help='full-rate output (VoltSpot)')
+parser.add_argument('-t', '--averaged', default='/dev/stderr',
+                    help='averaged output (HotSpot)')
+parser.add_argument('-k', '--factor', type=int, default=1,
+                    help='input rows per averaged row')
+parser.add_argument('--log', default=None,
+                    help='send this script\'s own errors here, for when stderr carries the averaged trace')
+args = parser.parse_args()
+
+with open(args.input, 'r') as infd, open(args.full, 'w') as full, open(args.averaged, 'w') as averaged:
+    if args.log:
+        # The outputs are already open, so /dev/stderr keeps pointing at the averaged consumer
+        os.dup2(os.open(args.log, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644), 2)
+    header = None
+    total = None
+    rows = 0
+    for line in infd:
+        if not line.split():
+            continue
+        full.write(line)
+        full.flush()
+        if header is None or args.factor == 1:
+            header = header or line
+            averaged.write(line)
+            averaged.flush()
+            continue
+        values = [float(f) for f in line.split()]
+        total = values if total is None else [a + b for a, b in zip(total, values)]
+        rows += 1
+        if rows == args.factor:
+            averaged.write('\t'.join('%g' % (p/rows) for p in total) + '\n')
+            averaged.flush()
+            total = None
+            rows = 0
+    if rows:
+        # A short last window is still spread over a whole averaged interval, which keeps the
+        # trace's total energy unchanged
+        averaged.write('\t'.join('%g' % (p/args.factor) for p in total) + '\n')
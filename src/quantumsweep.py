@@ -0,0 +1,90 @@
+#!/usr/bin/python3
+
+import argparse
+import os
+import re
+import subprocess as sproc
+import sys
+import time
+
+import gem5stats
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+cyclesPattern = re.compile(r"^system\.(?:switch_)?cpus?(\d*)\.numCycles$")
+instsPattern = re.compile(r"^system\.(?:switch_)?cpus?(\d*)\.committedInsts$")
+
+
+def Totals(m5out):
+    # sim_seconds and sim_insts are cumulative, so take them from the last dump; per-core cycles and
+    # instructions are reset with every dump, so sum those by core number
+    totals = {'sim_seconds': 0.0, 'sim_insts': 0.0, 'cycles': {}, 'insts': {}}
+    with open(os.path.join(m5out, 'stats.txt'), 'r') as fd:
+        for dump in gem5stats.ReadDumps(fd):
+            totals['sim_seconds'] = dump.get('sim_seconds', 0.0)
+            totals['sim_insts'] = dump.get('sim_insts', 0.0)
+            for name, value in dump.items():
+                for key, pattern in (('cycles', cyclesPattern), ('insts', instsPattern)):
+                    match = pattern.match(name)
+                    if match:
+                        core = int(match.group(1) or 0)
+                        totals[key][core] = totals[key].get(core, 0.0) + value
+    return totals
+
+
+def Run(args, name, extra):
+    m5out = os.path.join(args.outdir, name)
+    os.makedirs(m5out, exist_ok=True)
+    gem5_args = [args.gem5, '-d', m5out, os.path.join(root, 'config/run.py'),
+                 '--cpu-type', args.cpu_type, '-n', str(args.cores)] + extra + \
+        args.run_args.split() + [args.command]
+    start = time.time()
+    with open(os.path.join(m5out, 'gem5.log'), 'w') as log:
+        if sproc.call(gem5_args, stdout=log, stderr=sproc.STDOUT) != 0:
+            print('gem5 failed for %s; see %s' % (name, log.name), file=sys.stderr)
+            return None
+    totals = Totals(m5out)
+    totals['wall'] = time.time() - start
+    return totals
+
+
+def Error(value, reference):
+    return abs(value - reference)/reference if reference else 0.0
+
+
+parser = argparse.ArgumentParser(description='Compare parallel event-queue runs against the single-queue run for speed and accuracy.')
+parser.add_argument('command',
+                    help='workload command line (quoted)')
+parser.add_argument('-n', '--cores', type=int, default=4,
+                    help='number of cores')
+parser.add_argument('-q', '--quantum', nargs='+', default=['100ns', '1us', '10us'],
+                    help='synchronization quanta to try')
+parser.add_argument('--gem5', default=os.path.join(root, 'lib/gem5-riscv/build/RISCV/gem5.opt'),
+                    help='gem5 binary')
+parser.add_argument('--cpu-type', default='detailed',
+                    help='config/run.py CPU model')
+parser.add_argument('--run-args', default='--caches --l2cache 2MB 8',
+                    help='extra config/run.py arguments')
+parser.add_argument('-o', '--outdir', default='quantumsweep',
+                    help='directory for per-run gem5 output')
+args = parser.parse_args()
+
+# Runs go one at a time so wall-clock times aren't skewed by each other
+base = Run(args, 'single', [])
+if base is None:
+    sys.exit(1)
+print('%10s %10s %8s %12s %12s %14s' % ('quantum', 'wall (s)', 'speedup', 'sim time err', 'insts err', 'max core IPC err'))
+print('%10s %10.1f %8.2f %12s %12s %14s' % ('single', base['wall'], 1.0, '-', '-', '-'))
+# RISC-V has no KVM CPUs, so parallel runs use --parallel-unsafe; their errors include memory
+# system races between host threads, not only quantum skew
+for quantum in args.quantum:
+    result = Run(args, 'q' + quantum, ['--parallel', '--parallel-unsafe', '--sim-quantum', quantum])
+    if result is None:
+        continue
+    ipc_err = 0.0
+    for core, cycles in base['cycles'].items():
+        if cycles and result['cycles'].get(core):
+            ipc_err = max(ipc_err, Error(result['insts'].get(core, 0.0)/result['cycles'][core],
+                                         base['insts'].get(core, 0.0)/cycles))
+    print('%10s %10.1f %8.2f %11.3f%% %11.3f%% %13.3f%%' % (quantum, result['wall'], base['wall']/result['wall'],
+          100*Error(result['sim_seconds'], base['sim_seconds']), 100*Error(result['sim_insts'], base['sim_insts']), 100*ipc_err))
@@ -1,11 +1,56 @@
+import argparse
 import os
+import shlex
 
 import simmanager as sim
+import spotfiles
 import subprocess as sproc
 import time
 import atexit
 
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
 if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-o', '--outdir', default='.',
+                        help='directory for tool output; gem5 writes to OUTDIR/m5out')
+    parser.add_argument('--gem5', default=root + '/lib/gem5-riscv/build/X86/gem5.opt',
+                        help='gem5 binary')
+    parser.add_argument('--no-video', action='store_true',
+                        help='skip heatvideo and exit once gem5 and the power/thermal tools finish')
+    parser.add_argument('--thermal-rows', type=int, default=1,
+                        help='power trace rows averaged into each HotSpot step; VoltSpot still gets every row (heatvideo expects 1)')
+    parser.add_argument('--power-stage', action='store_true',
+                        help='compute power with powerstage.py (McPAT per interval on parallel -sim 1 workers, memoized) instead of the single -sim 1 McPAT chain')
+    parser.add_argument('--memo-tol', type=float, default=0.01,
+                        help='relative activity tolerance for reusing a memoized McPAT result with --power-stage; negative disables it')
+    parser.add_argument('--surrogate', type=int, default=0, metavar='N',
+                        help='with --power-stage, run McPAT only every Nth interval and estimate the rest with powerstage.py\'s linear surrogate')
+    parser.add_argument('--surrogate-tol', type=float, default=0.1,
+                        help='surrogate total-power error above which powerstage.py falls back to McPAT for every interval')
+    parser.add_argument('--power-jobs', type=int, default=os.cpu_count(),
+                        help='McPAT runs powerstage.py keeps in flight with --power-stage')
+    parser.add_argument('--drain', type=float, default=10,
+                        help='seconds McPAT gets to finish the last interval after gem5 exits (with --no-video)')
+    parser.add_argument('gem5_config', nargs=argparse.REMAINDER,
+                        help='gem5 config script followed by its arguments')
+    args = parser.parse_args()
+    if ('--dvfs-schedule' in args.gem5_config or args.gem5_config.count('--cpu-opp') > 1) and not args.power_stage:
+        # GEM5ToMcPAT.py keeps the template's static core clock_rate/vdd; powerstage.py's translator
+        # follows each core's DVFS domain per interval
+        print('DVFS operating points need per-interval McPAT clock and voltage; using --power-stage')
+        args.power_stage = True
+    if args.surrogate > 0 and not args.power_stage:
+        print('--surrogate estimates power in powerstage.py; using --power-stage')
+        args.power_stage = True
+    if args.thermal_rows > 1 and not args.no_video:
+        print('warning: heatvideo pairs one HotSpot frame per power row; with --thermal-rows %d it waits %d times longer for each' %
+              (args.thermal_rows, args.thermal_rows))
+    outdir = os.path.abspath(args.outdir)
+    m5out = os.path.join(outdir, 'm5out')
+    if not os.path.exists(outdir):
+        os.makedirs(outdir)
+
     print('Creating simulation manager...')
     sman = sim.SimManager()
     self_pid = os.getpid()
@@ -24,23 +69,26 @@ if __name__ == '__main__':
 #        except Exception as e:
 #            print(e)
 
-    gem5_args = '../lib/gem5-riscv/build/X86/gem5.opt ' + \
-        '../lib/gem5-riscv/configs/example/se.py ' + \
-        '--cpu-type=detailed -n 2 ' + \
-        '--sys-voltage=1V ' + \
-        '--sys-clock=3.7GHz --cpu-clock=3.7GHz ' + \
-        '--caches ' + \
-        '--l1d_size=32kB --l1d_assoc=8 ' + \
-        '--l1i_size=32kB --l1i_assoc=8 ' + \
-        '--l2cache --num-l2caches=1 --l2_size=8MB --l2_assoc=16 ' + \
-        '-c ../lib/gem5-riscv/tests/test-progs/hello/bin/x86/linux/hello;' + \
-           '../lib/gem5-riscv/tests/test-progs/hello/bin/x86/linux/hello'
+    if args.gem5_config:
+        gem5_config = ' '.join(shlex.quote(a) for a in args.gem5_config)
+    else:
+        gem5_config = root + '/lib/gem5-riscv/configs/example/se.py ' + \
+            '--cpu-type=detailed -n 2 ' + \
+            '--sys-voltage=1V ' + \
+            '--sys-clock=3.7GHz --cpu-clock=3.7GHz ' + \
+            '--caches ' + \
+            '--l1d_size=32kB --l1d_assoc=8 ' + \
+            '--l1i_size=32kB --l1i_assoc=8 ' + \
+            '--l2cache --num-l2caches=1 --l2_size=8MB --l2_assoc=16 ' + \
+            '-c ' + root + '/lib/gem5-riscv/tests/test-progs/hello/bin/x86/linux/hello;' + \
+               root + '/lib/gem5-riscv/tests/test-progs/hello/bin/x86/linux/hello'
+    gem5_args = args.gem5 + ' -d ' + m5out + ' ' + gem5_config
     print(gem5_args)
     gem5 = sman.StartTool(
         'gem5',
         gem5_args,
-        stdout=open('gem5.log', 'w'),
-        stderr=open('gem5.err', 'w'))
+        stdout=open(os.path.join(outdir, 'gem5.log'), 'w'),
+        stderr=open(os.path.join(outdir, 'gem5.err'), 'w'))
 
     time.sleep(3)
 
@@ -58,20 +106,19 @@ if __name__ == '__main__':
         'gridvol_gz',
         'gzip -acfq --best',
         stdin=sproc.PIPE,
-        stdout=open('voltspot.gridvol.gz', 'w'),
-        stderr=open('voltspot.gridvol.err', 'w'))
+        stdout=open(os.path.join(outdir, 'voltspot.gridvol.gz'), 'w'),
+        stderr=open(os.path.join(outdir, 'voltspot.gridvol.err'), 'w'))
     gridvol = sman.StartTool(   # Write gridvol to file
         'gridvol',
         'tee /dev/stderr',
         stdin=sproc.PIPE,
-        stdout=sproc.PIPE,
-#        stdout=sproc.DEVNULL,
+        stdout=sproc.DEVNULL if args.no_video else sproc.PIPE,
         stderr=gridvol_gz.stdin)
         #stderr=open('voltspot.gridvol', 'w'))
-    voltspot_args = '../lib/voltspot/bin/voltspot ' + \
-        '-f ../config/penryn.flp ' + \
+    voltspot_args = root + '/lib/voltspot/bin/voltspot ' + \
+        '-f ' + root + '/config/penryn.flp ' + \
         '-p /dev/stdin ' + \
-        '-c ../config/voltspot.config ' + \
+        '-c ' + root + '/config/voltspot.config ' + \
         '-v /dev/stdout ' + \
         '-gridvol_file /dev/stderr ' + \
         '-PDN_ptrace_start 1 ' + \
@@ -81,7 +128,7 @@ if __name__ == '__main__':
         'voltspot',
         voltspot_args,
         stdin=sproc.PIPE,
-        stdout=open('voltspot.log', 'w'),
+        stdout=open(os.path.join(outdir, 'voltspot.log'), 'w'),
         stderr=gridvol.stdin)
 #        stderr=sproc.DEVNULL)
 
@@ -89,49 +136,53 @@ if __name__ == '__main__':
         'gridtemp_gz',
         'gzip -acfq --best',
         stdin=sproc.PIPE,
-        stdout=open('hotspot.gridtemp.gz', 'w'),
-        stderr=open('hotspot.gridtemp.err', 'w'))
+        stdout=open(os.path.join(outdir, 'hotspot.gridtemp.gz'), 'w'),
+        stderr=open(os.path.join(outdir, 'hotspot.gridtemp.err'), 'w'))
     gridtemp = sman.StartTool(   # Write gridvol to file
         'gridtemp',
         'tee /dev/stderr',
         stdin=sproc.PIPE,
-        stdout=sproc.PIPE,
-#        stdout=sproc.DEVNULL,
+        stdout=sproc.DEVNULL if args.no_video else sproc.PIPE,
         stderr=gridtemp_gz.stdin)
 #        stderr=open('hotspot.gridtemp', 'w'))
-    hotspot_args = '../lib/hotspot/hotspot ' + \
-        '-f ../config/penryn.flp ' + \
+    # HotSpot steps once per averaged row, so its sampling interval grows by the same factor
+    sampling_intvl = float(spotfiles.ReadConfig(root + '/config/hotspot.config')['sampling_intvl'])
+    hotspot_args = root + '/lib/hotspot/hotspot ' + \
+        '-f ' + root + '/config/penryn.flp ' + \
         '-p /dev/stdin ' + \
-        '-c ../config/hotspot.config ' + \
-        '-o hotspot.ttrace ' + \
+        '-c ' + root + '/config/hotspot.config ' + \
+        '-sampling_intvl %g ' % (sampling_intvl*args.thermal_rows) + \
+        '-o ' + os.path.join(outdir, 'hotspot.ttrace') + ' ' + \
         '-grid_trans_file /dev/stderr'
     print(hotspot_args)
     hotspot = sman.StartTool(  # Run hotspot
         'hotspot',
         hotspot_args,
         stdin=sproc.PIPE,
-        stdout=open('hotspot.log', 'w'),
+        stdout=open(os.path.join(outdir, 'hotspot.log'), 'w'),
         stderr=gridtemp.stdin)
 #        stderr=sproc.DEVNULL)
 
-    gridvol_fd = gridvol.stdout.fileno()
-    gridtemp_fd = gridtemp.stdout.fileno()
-    heatvideo_args = 'python3 ../src/heatvideo.py ' + \
-        '-f ../config/penryn.flp ' + \
-        '-t /proc/%d/fd/%d ' % (self_pid, gridtemp_fd) + \
-        '-v /proc/%d/fd/%d ' % (self_pid, gridvol_fd) + \
-        '-o chip.mp4'
-    print(heatvideo_args)
-    heatvideo = sman.StartTool(
-        'heatvideo',
-        heatvideo_args,
-        stdin=sproc.DEVNULL,
-        stdout=open('heatvideo.log', 'w'),
-        stderr=open('heatvideo.err', 'w'))
-
-    ptrace_split = sman.StartTool(  # Send ptrace to hotspot and voltspot
+    if not args.no_video:
+        gridvol_fd = gridvol.stdout.fileno()
+        gridtemp_fd = gridtemp.stdout.fileno()
+        heatvideo_args = 'python3 ' + root + '/src/heatvideo.py ' + \
+            '-f ' + root + '/config/penryn.flp ' + \
+            '-t /proc/%d/fd/%d ' % (self_pid, gridtemp_fd) + \
+            '-v /proc/%d/fd/%d ' % (self_pid, gridvol_fd) + \
+            '-o ' + os.path.join(outdir, 'chip.mp4')
+        print(heatvideo_args)
+        heatvideo = sman.StartTool(
+            'heatvideo',
+            heatvideo_args,
+            stdin=sproc.DEVNULL,
+            stdout=open(os.path.join(outdir, 'heatvideo.log'), 'w'),
+            stderr=open(os.path.join(outdir, 'heatvideo.err'), 'w'))
+
+    ptrace_split = sman.StartTool(  # Send every ptrace row to voltspot and averaged rows to hotspot
         'ptrace_split',
-        'tee /dev/stderr',
+        'python3 ' + root + '/src/ptracerate.py -k %d -v /dev/stdout -t /dev/stderr --log %s' %
+        (args.thermal_rows, os.path.join(outdir, 'ptracerate.err')),
         stdin=sproc.PIPE,
         stdout=voltspot.stdin,
         stderr=hotspot.stdin)
@@ -140,66 +191,103 @@ if __name__ == '__main__':
         'tee /dev/stderr',
         stdin=sproc.PIPE,
         stdout=ptrace_split.stdin,
-        stderr=open('ptrace.txt', 'w'))
-    mcpat_hotspot_args = 'python2.7 ../lib/mcpat-riscv/McPATToHotSpot.py ' + \
-    '-o /dev/stdout ' + \
-    '/dev/stdin'
-    print(mcpat_hotspot_args)
-    mcpat_hotspot = sman.StartTool(
-        'mcpat-hotspot',
-        mcpat_hotspot_args,
-        stdin=sproc.PIPE,
-        stdout=ptrace_save.stdin,
-        stderr=open('mcpat-hotspot.err', 'w'))
+        stderr=open(os.path.join(outdir, 'ptrace.txt'), 'w'))
+    if not args.power_stage:
+        mcpat_hotspot_args = 'python2.7 ' + root + '/lib/mcpat-riscv/McPATToHotSpot.py ' + \
+        '-o /dev/stdout ' + \
+        '/dev/stdin'
+        print(mcpat_hotspot_args)
+        mcpat_hotspot = sman.StartTool(
+            'mcpat-hotspot',
+            mcpat_hotspot_args,
+            stdin=sproc.PIPE,
+            stdout=ptrace_save.stdin,
+            stderr=open(os.path.join(outdir, 'mcpat-hotspot.err'), 'w'))
 
-    mcpat_out_gz = sman.StartTool(
-        'mcpat_out_gz',
-        'gzip -acfq --best',
-        stdin=sproc.PIPE,
-        stdout=open('mcpat_out.gz', 'w'),
-        stderr=open('mcpat_out_gz.err', 'w'))
-    mcpat_out = sman.StartTool(
-        'mcpat_out',
-        'tee /dev/stderr',
-        stdin=sproc.PIPE,
-        stdout=mcpat_hotspot.stdin,
-        stderr=mcpat_out_gz.stdin)
-        #stderr=open('mcpat_out.txt', 'w'))
-    mcpat_args = '../../lib/mcpat-riscv/mcpat ' + \
-    '-infile _sim.xml ' + \
-    '-print_level 5 ' + \
-    '-is_tdp 0 ' + \
-    '-sim 1 ' + \
-    '-out_switch 0'
-    print(mcpat_args)
-    mcpat = sman.StartTool(
-        'mcpat',
-        mcpat_args,
-        cwd='./m5out',
-        stdout=mcpat_out.stdin,
-        stderr=open('mcpat.err', 'w'))
-
-    gem5_mcpat_args = 'python2.7 ../../lib/mcpat-riscv/GEM5ToMcPAT.py ' + \
-        '--quiet ' + \
-        '--sim ' + \
-        '--out sim.xml ' + \
-        '/dev/stdin ' + \
-        './config.json ' + \
-        '../../config/Penryn.xml'
-    print(gem5_mcpat_args)
-    gem5_mcpat = sman.StartTool(
-        'gem5-mcpat',
-        gem5_mcpat_args,
-        cwd='./m5out',
-        stdin=sproc.PIPE,
-        stdout=open('gem5-mcpat.log', 'w'),
-        stderr=open('gem5-mcpat.err', 'w'))
-    gem5_mcpat_feed = sman.StartTool(
-        'gem5-mcpat-feed',
-        'tail -f ./m5out/stats.txt',
-        stdout=gem5_mcpat.stdin)
+        mcpat_out_gz = sman.StartTool(
+            'mcpat_out_gz',
+            'gzip -acfq --best',
+            stdin=sproc.PIPE,
+            stdout=open(os.path.join(outdir, 'mcpat_out.gz'), 'w'),
+            stderr=open(os.path.join(outdir, 'mcpat_out_gz.err'), 'w'))
+        mcpat_out = sman.StartTool(
+            'mcpat_out',
+            'tee /dev/stderr',
+            stdin=sproc.PIPE,
+            stdout=mcpat_hotspot.stdin,
+            stderr=mcpat_out_gz.stdin)
+            #stderr=open('mcpat_out.txt', 'w'))
+        mcpat_args = root + '/lib/mcpat-riscv/mcpat ' + \
+        '-infile _sim.xml ' + \
+        '-print_level 5 ' + \
+        '-is_tdp 0 ' + \
+        '-sim 1 ' + \
+        '-out_switch 0'
+        print(mcpat_args)
+        mcpat = sman.StartTool(
+            'mcpat',
+            mcpat_args,
+            cwd=m5out,
+            stdout=mcpat_out.stdin,
+            stderr=open(os.path.join(outdir, 'mcpat.err'), 'w'))
+
+        gem5_mcpat_args = 'python2.7 ' + root + '/lib/mcpat-riscv/GEM5ToMcPAT.py ' + \
+            '--quiet ' + \
+            '--sim ' + \
+            '--out sim.xml ' + \
+            '/dev/stdin ' + \
+            './config.json ' + \
+            root + '/config/Penryn.xml'
+        print(gem5_mcpat_args)
+        gem5_mcpat = sman.StartTool(
+            'gem5-mcpat',
+            gem5_mcpat_args,
+            cwd=m5out,
+            stdin=sproc.PIPE,
+            stdout=open(os.path.join(outdir, 'gem5-mcpat.log'), 'w'),
+            stderr=open(os.path.join(outdir, 'gem5-mcpat.err'), 'w'))
+        gem5_mcpat_feed = sman.StartTool(
+            'gem5-mcpat-feed',
+            'tail -F --pid=%d %s' % (gem5.pid, os.path.join(m5out, 'stats.txt')),
+            stdout=gem5_mcpat.stdin)
+    else:
+        power_stage_args = 'python3 ' + root + '/src/powerstage.py ' + \
+            '--m5out ' + m5out + ' ' + \
+            '--memo-tol %g ' % args.memo_tol + \
+            '--jobs %d ' % args.power_jobs + \
+            '--surrogate %d --surrogate-tol %g ' % (args.surrogate, args.surrogate_tol) + \
+            '/dev/stdin'
+        print(power_stage_args)
+        power_stage = sman.StartTool(
+            'power-stage',
+            power_stage_args,
+            stdin=sproc.PIPE,
+            stdout=ptrace_save.stdin,
+            stderr=open(os.path.join(outdir, 'powerstage.err'), 'w'))
+        gem5_mcpat_feed = sman.StartTool(
+            'gem5-mcpat-feed',
+            'tail -F --pid=%d %s' % (gem5.pid, os.path.join(m5out, 'stats.txt')),
+            stdout=power_stage.stdin)
+
+    # Drop the parent's copies of the pipe write ends so EOF can propagate down the chain
+    power_tools = (power_stage,) if args.power_stage else (mcpat_hotspot, mcpat_out_gz, mcpat_out, gem5_mcpat)
+    for tool in (gridvol_gz, gridvol, voltspot, gridtemp_gz, gridtemp, hotspot,
+                 ptrace_split, ptrace_save) + power_tools:
+        tool.stdin.close()
 
     print('Waiting for output...')
-    heatvideo.communicate()[0]
+    if args.no_video:
+        gem5.wait()
+        gem5_mcpat_feed.wait()
+        if args.power_stage:
+            power_stage.wait()
+        else:
+            gem5_mcpat.wait()
+            time.sleep(args.drain)
+            mcpat.terminate()
+        voltspot.wait()
+        hotspot.wait()
+    else:
+        heatvideo.communicate()[0]
 #    voltspot.communicate()[0]
 #    hotspot.communicate()[0]
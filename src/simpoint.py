@@ -0,0 +1,244 @@
+#!/usr/bin/python3
+
+import argparse
+import gzip
+import os
+import re
+import subprocess as sproc
+import sys
+import time
+
+import numpy as np
+
+import gem5stats
+import simmanager as sim
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+# A simpoint at interval 0 has nothing to fast-forward, so it runs on system.cpu without switching
+cyclesPattern = re.compile(r"^system\.(?:switch_)?cpus?\d*\.numCycles$")
+instsPattern = re.compile(r"^system\.(?:switch_)?cpus?\d*\.committedInsts$")
+
+
+def ReadBBV(filename):
+    # gem5 SimPoint probe output: one "T:bb:count :bb:count ..." line per interval
+    vectors = []
+    with gzip.open(filename, 'rt') as fd:
+        for line in fd:
+            if line.startswith('T'):
+                vectors.append(dict((int(bb), int(count)) for bb, count in
+                                    (field.split(':') for field in line[1:].split(':', 1)[1].split(' :') if field.strip())))
+    return vectors
+
+
+def Project(vectors, dims, seed):
+    # Normalize each interval's BBV and project it to a few random dimensions, as SimPoint does
+    rng = np.random.RandomState(seed)
+    projection = {}
+    data = np.zeros((len(vectors), dims))
+    for i, vector in enumerate(vectors):
+        total = float(sum(vector.values()))
+        for bb, count in vector.items():
+            if bb not in projection:
+                projection[bb] = rng.uniform(-1, 1, dims)
+            data[i] += projection[bb]*count/total
+    return data
+
+
+def KMeans(data, k, seed, iterations=100):
+    rng = np.random.RandomState(seed)
+    centers = data[rng.choice(len(data), k, replace=False)]
+    for _ in range(iterations):
+        distances = ((data[:, None, :] - centers[None, :, :])**2).sum(axis=2)
+        labels = distances.argmin(axis=1)
+        moved = np.array([data[labels == c].mean(axis=0) if (labels == c).any() else centers[c] for c in range(k)])
+        if np.allclose(moved, centers):
+            break
+        centers = moved
+    return labels, centers
+
+
+def BIC(data, labels, centers):
+    # Spherical-Gaussian BIC (Pelleg and Moore), the score SimPoint uses to pick k
+    n, d = data.shape
+    k = len(centers)
+    variance = max(((data - centers[labels])**2).sum()/max(n - k, 1), 1e-12)
+    likelihood = 0.0
+    for c in range(k):
+        size = (labels == c).sum()
+        if size:
+            likelihood += size*np.log(size) - size*np.log(n) - size/2.0*np.log(2*np.pi) - \
+                size*d/2.0*np.log(variance) - (size - k)/2.0
+    return likelihood - ((k - 1) + d*k + 1)/2.0*np.log(n)
+
+
+def Cluster(args, bbv, simpoints_file, weights_file):
+    if args.simpoint_bin:
+        sproc.check_call([args.simpoint_bin, '-loadFVFile', bbv, '-inputVectorsGzipped',
+                          '-maxK', str(args.max_k),
+                          '-saveSimpoints', simpoints_file, '-saveSimpointWeights', weights_file])
+        return
+    data = Project(ReadBBV(bbv), args.dims, args.seed)
+    results = []
+    for k in range(1, min(args.max_k, len(data)) + 1):
+        labels, centers = KMeans(data, k, args.seed)
+        results.append((BIC(data, labels, centers), labels, centers))
+    # Smallest k whose score reaches 90% of the observed BIC range
+    scores = [r[0] for r in results]
+    threshold = min(scores) + 0.9*(max(scores) - min(scores))
+    score, labels, centers = next(r for r in results if r[0] >= threshold)
+    with open(simpoints_file, 'w') as sfd, open(weights_file, 'w') as wfd:
+        cluster = 0
+        for c in range(len(centers)):
+            members = np.where(labels == c)[0]
+            if len(members) == 0:
+                continue
+            closest = members[((data[members] - centers[c])**2).sum(axis=1).argmin()]
+            sfd.write('%d %d\n' % (closest, cluster))
+            wfd.write('%.6f %d\n' % (float(len(members))/len(data), cluster))
+            cluster += 1
+
+
+def ReadWeights(weights_file):
+    weights = {}
+    with open(weights_file, 'r') as fd:
+        for line in fd:
+            w = line.split()
+            weights[int(w[1])] = float(w[0])
+    return weights
+
+
+def Summarize(outdir, dump_period):
+    # IPC over all dumps (sim_insts is cumulative and counts the fast-forward, so use the per-dump
+    # committed instructions; the switched-out CPUs count nothing after the reset), energy from the
+    # power trace, and per-block peak/mean temperature
+    insts = 0.0
+    cycles = 0.0
+    with open(os.path.join(outdir, 'm5out/stats.txt'), 'r') as fd:
+        for dump in gem5stats.ReadDumps(fd):
+            insts += sum(v for k, v in dump.items() if instsPattern.match(k))
+            cycles += max([v for k, v in dump.items() if cyclesPattern.match(k)] or [0.0])
+    with open(os.path.join(outdir, 'ptrace.txt'), 'r') as fd:
+        names, rows = spotfiles.ReadPtrace(fd)
+    energy = sum(sum(row) for row in rows)*dump_period
+    with open(os.path.join(outdir, 'hotspot.ttrace'), 'r') as fd:
+        blocks, temps = spotfiles.ReadPtrace(fd)
+    temps = np.array(temps)
+    return {'ipc': insts/cycles if cycles else 0.0,
+            'cycles': cycles,
+            'energy': energy,
+            'blocks': blocks,
+            'peak': temps.max(axis=0) if len(temps) else np.zeros(len(blocks)),
+            'mean': temps.mean(axis=0) if len(temps) else np.zeros(len(blocks))}
+
+
+parser = argparse.ArgumentParser(description='Profile, cluster and co-simulate SimPoints, then weight the results.')
+parser.add_argument('mode', choices=['profile', 'cluster', 'run', 'report', 'all'],
+                    help='pipeline step to perform')
+parser.add_argument('command',
+                    help='workload command line (quoted)')
+parser.add_argument('-i', '--interval', type=int, default=10000000,
+                    help='SimPoint interval in instructions')
+parser.add_argument('-k', '--max-k', type=int, default=30,
+                    help='maximum number of clusters')
+parser.add_argument('--dims', type=int, default=15,
+                    help='random projection dimensions for the builtin clustering')
+parser.add_argument('--seed', type=int, default=493575226,
+                    help='random seed for projection and k-means')
+parser.add_argument('--simpoint-bin', default=None,
+                    help='use the SimPoint 3 binary instead of the builtin clustering')
+parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                    help='clusters to co-simulate concurrently')
+parser.add_argument('-d', '--dump-period', type=float, default=0.01,
+                    help='stat dump (and power trace) period in milliseconds')
+parser.add_argument('--gem5', default=os.path.join(root, 'lib/gem5-riscv/build/RISCV/gem5.opt'),
+                    help='gem5 binary')
+parser.add_argument('--cpu-type', default='detailed',
+                    help='config/run.py CPU model for the simpoints')
+parser.add_argument('--run-args', default='--caches',
+                    help='extra config/run.py arguments')
+parser.add_argument('-o', '--outdir', default='simpoint',
+                    help='directory for profile, clusters and per-cluster results')
+args = parser.parse_args()
+
+outdir = os.path.abspath(args.outdir)
+if not os.path.exists(outdir):
+    os.makedirs(outdir)
+bbv = os.path.join(outdir, 'profile/simpoint.bb.gz')
+simpoints_file = os.path.join(outdir, 'simpoints')
+weights_file = os.path.join(outdir, 'weights')
+
+if args.mode in ('profile', 'all'):
+    print('Profiling basic block vectors...')
+    sproc.check_call([args.gem5, '-d', os.path.join(outdir, 'profile'), os.path.join(root, 'config/run.py'),
+                      '--cpu-type', 'atomic', '--simpoint-interval', str(args.interval)] +
+                     args.run_args.split() + [args.command],
+                     stdout=open(os.path.join(outdir, 'profile.log'), 'w'), stderr=sproc.STDOUT)
+
+if args.mode in ('cluster', 'all'):
+    print('Clustering...')
+    Cluster(args, bbv, simpoints_file, weights_file)
+
+weights = ReadWeights(weights_file)
+failed = set()
+
+if args.mode in ('run', 'all'):
+    sman = sim.SimManager()
+    pending = sorted(weights)
+    running = {}
+    while pending or running:
+        while pending and len(running) < args.jobs:
+            cluster = pending.pop(0)
+            cluster_dir = os.path.join(outdir, 'cluster%d' % cluster)
+            reclaim_args = 'python3 %s -o %s --no-video --gem5 %s %s --cpu-type %s ' \
+                '--simpoint-interval %d --run-simpoint %s %s %d -d %g %s "%s"' % \
+                (os.path.join(root, 'src/reclaim.py'), cluster_dir, args.gem5, os.path.join(root, 'config/run.py'),
+                 args.cpu_type, args.interval, simpoints_file, weights_file, cluster, args.dump_period,
+                 args.run_args, args.command)
+            print('Starting cluster %d: %s' % (cluster, reclaim_args))
+            running[cluster] = sman.StartTool('cluster%d' % cluster, reclaim_args,
+                                              stdout=open(cluster_dir + '.log', 'w'), stderr=sproc.STDOUT)
+        for cluster, proc in list(running.items()):
+            if proc.poll() is not None:
+                print('Cluster %d finished (%d)' % (cluster, proc.returncode))
+                if proc.returncode != 0:
+                    failed.add(cluster)
+                del running[cluster]
+        time.sleep(1)
+
+if args.mode in ('report', 'run', 'all'):
+    with gzip.open(bbv, 'rt') as fd:
+        intervals = sum(1 for line in fd if line.startswith('T'))
+    ipc = 0.0
+    energy = 0.0
+    peak = None
+    mean = None
+    # Leave out clusters whose run failed, left no results or counted no cycles, and reweight the rest
+    results = {}
+    for cluster in sorted(weights):
+        if cluster in failed or not os.path.exists(os.path.join(outdir, 'cluster%d' % cluster, 'hotspot.ttrace')):
+            print('Cluster %d failed; left out of the weighted results' % cluster, file=sys.stderr)
+            continue
+        result = Summarize(os.path.join(outdir, 'cluster%d' % cluster), args.dump_period*1e-3)
+        if not result['cycles']:
+            print('Cluster %d counted no CPU cycles; left out of the weighted results' % cluster, file=sys.stderr)
+            continue
+        results[cluster] = result
+    if not results:
+        sys.exit(1)
+    coverage = sum(weights[c] for c in results)
+    print('%8s %8s %8s %14s %10s' % ('cluster', 'weight', 'IPC', 'energy (J)', 'peak (K)'))
+    for cluster, result in sorted(results.items()):
+        w = weights[cluster]/coverage
+        print('%8d %8.4f %8.4f %14.6g %10.2f' % (cluster, w, result['ipc'], result['energy'], result['peak'].max()))
+        ipc += w*result['ipc']
+        energy += w*result['energy']
+        peak = result['peak'] if peak is None else np.maximum(peak, result['peak'])
+        mean = w*result['mean'] if mean is None else mean + w*result['mean']
+        blocks = result['blocks']
+    print('weighted IPC %.4f (clusters covering %.1f%% of the program)' % (ipc, 100*coverage))
+    print('weighted energy per interval %.6g J; whole program (%d intervals) %.6g J' % (energy, intervals, energy*intervals))
+    print('%-24s %10s %10s' % ('block', 'peak (K)', 'mean (K)'))
+    for i, block in enumerate(blocks):
+        print('%-24s %10.2f %10.2f' % (block, peak[i], mean[i]))
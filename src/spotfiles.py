@@ -0,0 +1,102 @@
+#!/usr/bin/python3
+import itertools
+from collections import OrderedDict
+
+
+def ReadPtrace(fd):
+    # HotSpot/VoltSpot power trace: a header line of block names, then one row of watts per sample
+    names = None
+    rows = []
+    for line in fd:
+        fields = line.split()
+        if not fields:
+            continue
+        if names is None:
+            names = fields
+        else:
+            rows.append([float(f) for f in fields])
+    return names, rows
+
+
+def WritePtrace(fd, names, rows):
+    fd.write('\t'.join(names) + '\n')
+    for row in rows:
+        fd.write('\t'.join('%g' % p for p in row) + '\n')
+
+
+def ReadConfig(filename):
+    # HotSpot/VoltSpot config: "-name value" pairs, '#' starts a comment
+    config = {}
+    with open(filename, 'r') as fd:
+        for line in fd:
+            fields = line.split('#', 1)[0].split()
+            if len(fields) >= 2 and fields[0][0] == '-':
+                config[fields[0][1:]] = fields[1]
+    return config
+
+
+def Label(point):
+    # One sweep point as "name=value ..." for reports
+    return ' '.join('%s=%s' % item for item in point.items()) or 'base'
+
+
+def Feed(proc, data, chunk=1 << 20):
+    # Stream an in-memory trace into one tool's stdin; a broken pipe just means that run failed
+    try:
+        for i in range(0, len(data), chunk):
+            proc.stdin.write(data[i:i + chunk])
+        proc.stdin.close()
+    except BrokenPipeError:
+        pass
+
+
+def ParseSweep(specs):
+    # "name=v1,v2,..." per swept parameter -> one OrderedDict of overrides per point of the
+    # cross product, in the order the specs were given
+    names = []
+    values = []
+    for spec in specs:
+        name, vals = spec.split('=', 1)
+        names.append(name.lstrip('-'))
+        values.append(vals.split(','))
+    return [OrderedDict(zip(names, point)) for point in itertools.product(*values)]
+
+
+def ReadFloorplan(filename):
+    # Returns a list of (name, width, height, left-x, bottom-y) in meters, in file order
+    blocks = []
+    with open(filename, 'r') as fd:
+        for line in fd:
+            fields = line.split('#', 1)[0].split()
+            if len(fields) >= 5:
+                blocks.append((fields[0],) + tuple(float(f) for f in fields[1:5]))
+    return blocks
+
+
+def ChipSize(blocks):
+    return (max(b[3] + b[1] for b in blocks), max(b[4] + b[2] for b in blocks))
+
+
+def ReadGridFrames(fd):
+    # Grid dumps (-gridvol_file, -grid_trans_file): rows of values, frames separated by blank lines
+    frame = []
+    for line in fd:
+        fields = line.split()
+        if fields:
+            frame.append([float(f) for f in fields])
+        elif frame:
+            yield frame
+            frame = []
+    if frame:
+        yield frame
+
+
+def GridDroop(fd, vdd, threshold=float('inf')):
+    # Worst droop below vdd over a grid voltage stream, and how many frames reach threshold
+    droop = 0.0
+    violations = 0
+    for frame in ReadGridFrames(fd):
+        frame_droop = vdd - min(min(row) for row in frame)
+        droop = max(droop, frame_droop)
+        violations += frame_droop >= threshold
+    return droop, violations
@@ -0,0 +1,230 @@
+#!/usr/bin/python3
+
+import argparse
+import gzip
+import os
+import re
+import sys
+from collections import OrderedDict
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+addrPattern = re.compile(r"(?:^|\s)(?:addr|A)=(0x[0-9a-fA-F]+|\d+)\b")
+
+
+class Fenwick:
+    # Counts of live (most recent) references per set-local timestamp, the first live of them set.
+    # Built in O(n).
+    def __init__(self, size=64, live=0):
+        self.flags = [1]*live + [0]*(size - live)
+        n = len(self.flags)
+        self.tree = [0] + self.flags[:]
+        for i in range(1, n + 1):
+            j = i + (i & -i)
+            if j <= n:
+                self.tree[j] += self.tree[i]
+
+    def Add(self, i, delta):
+        self.flags[i] += delta
+        i += 1
+        n = len(self.flags)
+        while i <= n:
+            self.tree[i] += delta
+            i += i & -i
+
+    def Prefix(self, i):
+        # Sum of flags[0:i]
+        total = 0
+        while i > 0:
+            total += self.tree[i]
+            i -= i & -i
+        return total
+
+
+class StackDistances:
+    # LRU stack distances within each set, for every power-of-two set count at once.  A reference
+    # hits in an S-set, A-way LRU cache exactly when its distance in its set is below A.
+    def __init__(self, set_counts, max_ways, rate):
+        self.set_counts = set_counts
+        self.max_ways = max_ways
+        self.rate = rate
+        self.last = dict((s, {}) for s in set_counts)
+        self.sets = dict((s, {}) for s in set_counts)
+        # hist[s][d] for d < max_ways; hist[s][max_ways] collects deeper reuses and cold misses
+        self.hist = dict((s, [0]*(max_ways + 1)) for s in set_counts)
+        self.references = 0
+
+    def Access(self, line):
+        self.references += 1
+        for s in self.set_counts:
+            index = line & (s - 1)
+            state = self.sets[s].get(index)
+            if state is None:
+                state = self.sets[s][index] = [Fenwick(), 0, []]
+            if state[1] >= len(state[0].flags):
+                self.Compact(s, state)
+            tree, now, owners = state
+            previous = self.last[s].get(line)
+            if previous is None:
+                depth = self.max_ways
+            else:
+                # Sampled lines stand for 1/rate lines each (SHARDS), so scale the distance
+                depth = min(int((tree.Prefix(now) - tree.Prefix(previous + 1))/self.rate), self.max_ways)
+                tree.Add(previous, -1)
+            self.hist[s][depth] += 1
+            tree.Add(now, 1)
+            owners.append(line)
+            self.last[s][line] = now
+            state[1] = now + 1
+
+    def Compact(self, s, state):
+        # The set's timeline is full: renumber its live timestamps 0..n-1 in order, which keeps
+        # every distance, and double the timeline only if more than half of it is live.  Each
+        # timeline stays within twice the lines mapping to its set, not the trace length.
+        tree, now, owners = state
+        live = [line for line, flag in zip(owners, tree.flags) if flag]
+        size = len(tree.flags)*2 if len(live) > len(tree.flags)//2 else len(tree.flags)
+        for i, line in enumerate(live):
+            self.last[s][line] = i
+        state[:] = [Fenwick(size, len(live)), len(live), live]
+
+    def MissRatio(self, sets, ways):
+        hist = self.hist[sets]
+        return float(sum(hist[ways:]))/self.references if self.references else 0.0
+
+
+class LRUCache:
+    # Exact LRU cache used to filter the reference stream down to what reaches the next level
+    def __init__(self, sets, ways):
+        self.sets = [OrderedDict() for _ in range(sets)]
+        self.ways = ways
+
+    def Access(self, line):
+        lines = self.sets[line % len(self.sets)]
+        if line in lines:
+            lines.move_to_end(line)
+            return True
+        lines[line] = True
+        if len(lines) > self.ways:
+            lines.popitem(last=False)
+        return False
+
+
+def ReadConfig(filename):
+    # KEY=VALUE lines as in config/rocket.config
+    config = {}
+    with open(filename, 'r') as fd:
+        for line in fd:
+            if line.strip() and line.strip()[0] != '#':
+                key, value = (s.strip() for s in line.split('=', 1))
+                config[key] = value
+    return config
+
+
+def Open(filename):
+    return gzip.open(filename, 'rt') if filename.endswith('.gz') else open(filename, 'r')
+
+
+def TextAddresses(filename):
+    # "<r|w> <address>" lines, or lines with an explicit addr= or A= field (gem5 debug and Exec
+    # output).  Other lines are skipped rather than guessed at: their first 0x value is usually a PC.
+    skipped = 0
+    with Open(filename) as fd:
+        for line in fd:
+            fields = line.split()
+            if len(fields) >= 2 and fields[0].lower() in ('r', 'w'):
+                yield int(fields[1], 0)
+                continue
+            match = addrPattern.search(line)
+            if match:
+                yield int(match.group(1), 0)
+            elif fields:
+                skipped += 1
+    if skipped:
+        print('stackdist: skipped %d lines without an "r|w <address>" form or an addr=/A= field' % skipped, file=sys.stderr)
+
+
+def ProtoRecords(filename, gem5, header_type, record_type, module):
+    # gem5's protobuf traces: "gem5" magic, a header message, then length-prefixed records
+    sys.path += [os.path.join(gem5, 'util'), os.path.join(gem5, 'build', 'RISCV', 'proto')]
+    import protolib
+    messages = __import__(module)
+    fd = protolib.openFileRd(filename)
+    magic = fd.read(4)
+    if magic not in ('gem5', b'gem5'):
+        raise ValueError('%s is not a gem5 protobuf trace' % filename)
+    protolib.decodeMessage(fd, getattr(messages, header_type)())
+    record = getattr(messages, record_type)()
+    while protolib.decodeMessage(fd, record):
+        yield record
+
+
+def Addresses(args):
+    if args.format == 'text':
+        return TextAddresses(args.trace)
+    if args.format == 'packet':
+        # CommMonitor packet traces and the elastic trace instruction fetch stream
+        return (p.addr for p in ProtoRecords(args.trace, args.gem5, 'PacketHeader', 'Packet', 'packet_pb2'))
+    # Elastic trace data dependency stream: loads and stores only
+    return (r.p_addr for r in ProtoRecords(args.trace, args.gem5, 'InstDepRecordHeader', 'InstDepRecord', 'inst_dep_record_pb2')
+            if r.type in (1, 2))
+
+
+parser = argparse.ArgumentParser(description='Single-pass LRU stack distance analysis: miss ratio curves for every set count and associativity.')
+parser.add_argument('trace',
+                    help='memory reference trace')
+parser.add_argument('-f', '--format', choices=['text', 'packet', 'etrace'], default='text',
+                    help='trace format: text ("r|w <address>" lines, or lines with an addr= or A= field), a gem5 packet trace, or an elastic trace data file')
+parser.add_argument('-c', '--config', default=None,
+                    help='rocket.config-style file; sets the line size and marks the configured L1D or L2 point')
+parser.add_argument('--level', choices=['l1d', 'l2'], default='l1d',
+                    help='cache level to analyze; l2 filters the stream through the configured L1D first')
+parser.add_argument('--sets', type=int, nargs=2, default=[1, 4096], metavar=('MIN', 'MAX'),
+                    help='range of power-of-two set counts')
+parser.add_argument('--max-ways', type=int, default=16,
+                    help='largest associativity to report')
+parser.add_argument('--line', type=int, default=64,
+                    help='cache line size in bytes (CACHE_BLOCK_BYTES overrides it)')
+parser.add_argument('-r', '--rate', type=float, default=1.0,
+                    help='SHARDS spatial sampling rate; below 1, only lines whose hash falls under it are analyzed')
+parser.add_argument('--gem5', default=os.path.join(root, 'lib/gem5-riscv'),
+                    help='gem5 tree for protolib and the generated protobuf modules')
+args = parser.parse_args()
+
+config = ReadConfig(args.config) if args.config else {}
+line_bytes = int(config.get('CACHE_BLOCK_BYTES', args.line))
+line_bits = line_bytes.bit_length() - 1
+set_counts = [1 << i for i in range(args.sets[0].bit_length() - 1, args.sets[1].bit_length())]
+
+l1 = None
+if args.level == 'l2':
+    l1 = LRUCache(int(config.get('L1D_SETS', 64)), int(config.get('L1D_WAYS', 4)))
+
+threshold = int(args.rate*(1 << 24))
+analysis = StackDistances(set_counts, args.max_ways, args.rate)
+references = 0
+for address in Addresses(args):
+    line = address >> line_bits
+    references += 1
+    if l1 and l1.Access(line):
+        continue
+    # Hash on the line so a sampled line is followed through its whole lifetime
+    if args.rate < 1.0 and (((line*0x9E3779B97F4A7C15) & 0xFFFFFFFFFFFFFFFF) >> 40) >= threshold:
+        continue
+    analysis.Access(line)
+
+print('# %d references, %d analyzed at %s (rate %g), %dB lines' % (references, analysis.references, args.level, args.rate, line_bytes))
+print('# miss ratio by sets (rows) and ways (columns)')
+print('%6s ' % 'sets' + ' '.join('%7d' % w for w in range(1, args.max_ways + 1)))
+for s in set_counts:
+    print('%6d ' % s + ' '.join('%7.4f' % analysis.MissRatio(s, w) for w in range(1, args.max_ways + 1)))
+
+if config:
+    if args.level == 'l1d':
+        sets, ways = int(config.get('L1D_SETS', 64)), int(config.get('L1D_WAYS', 4))
+    else:
+        ways = int(config.get('L2_WAYS', 8))
+        sets = int(config.get('L2_CAPACITY_IN_KB', 64))*1024//(line_bytes*ways)
+    if sets in set_counts and ways <= args.max_ways:
+        print('# configured %s: %d sets x %d ways (%d kB): miss ratio %.4f' %
+              (args.level, sets, ways, sets*ways*line_bytes//1024, analysis.MissRatio(sets, ways)))
@@ -0,0 +1,91 @@
+#!/usr/bin/python3
+
+import argparse
+import os
+import subprocess as sproc
+import sys
+import threading
+import time
+
+import numpy as np
+
+import simmanager as sim
+import spotfiles
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+parser = argparse.ArgumentParser(description='Replay one power trace through many HotSpot configurations at once.')
+parser.add_argument('ptrace',
+                    help='recorded power trace')
+parser.add_argument('-s', '--sweep', action='append', default=[],
+                    metavar='NAME=V1,V2,...', help='HotSpot parameter and values to sweep (repeat for a cross product)')
+parser.add_argument('-k', '--factor', type=int, default=1,
+                    help='average this many ptrace rows per HotSpot step, as reclaim.py --thermal-rows does')
+parser.add_argument('-i', '--interval', type=float, default=None,
+                    help='ptrace row interval in seconds (default: sampling_intvl from the HotSpot config)')
+parser.add_argument('-c', '--config', default=os.path.join(root, 'config/hotspot.config'),
+                    help='base HotSpot config file')
+parser.add_argument('-f', '--floorplan', default=os.path.join(root, 'config/penryn.flp'),
+                    help='floorplan file')
+parser.add_argument('--hotspot', default=os.path.join(root, 'lib/hotspot/hotspot'),
+                    help='HotSpot binary')
+parser.add_argument('-o', '--outdir', default='thermalsweep',
+                    help='directory for per-configuration temperature traces')
+args = parser.parse_args()
+
+outdir = os.path.abspath(args.outdir)
+if not os.path.exists(outdir):
+    os.makedirs(outdir)
+interval = args.interval or float(spotfiles.ReadConfig(args.config)['sampling_intvl'])
+
+# Parse the trace once; every configuration reads the same in-memory text
+with open(args.ptrace, 'r') as fd:
+    names, rows = spotfiles.ReadPtrace(fd)
+rows = np.array(rows)
+if args.factor > 1:
+    # Energy-conserving averages, padding a short last window with zero power
+    padded = np.zeros((-(-len(rows)//args.factor)*args.factor, len(names)))
+    padded[:len(rows)] = rows
+    rows = padded.reshape(-1, args.factor, len(names)).mean(axis=1)
+lines = ['\t'.join(names) + '\n'] + ['\t'.join('%g' % p for p in row) + '\n' for row in rows]
+data = ''.join(lines).encode()
+
+points = spotfiles.ParseSweep(args.sweep)
+sman = sim.SimManager()
+runs = []
+start = time.time()
+for i, point in enumerate(points):
+    hotspot_args = '%s -f %s -p /dev/stdin -c %s -o %s -sampling_intvl %g' % \
+        (args.hotspot, args.floorplan, args.config, os.path.join(outdir, 'config%d.ttrace' % i), interval*args.factor)
+    hotspot_args += ''.join(' -%s %s' % item for item in point.items())
+    proc = sman.StartTool('config%d' % i, hotspot_args, stdin=sproc.PIPE,
+                          stdout=open(os.path.join(outdir, 'config%d.log' % i), 'w'), stderr=sproc.STDOUT)
+    feeder = threading.Thread(target=spotfiles.Feed, args=(proc, data))
+    feeder.start()
+    runs.append((point, proc, feeder))
+for point, proc, feeder in runs:
+    feeder.join()
+    proc.wait()
+print('%d configurations, %d steps each, in %.1f s' % (len(points), len(rows), time.time() - start))
+
+results = []
+for i, (point, proc, feeder) in enumerate(runs):
+    ttrace = os.path.join(outdir, 'config%d.ttrace' % i)
+    if proc.returncode != 0 or not os.path.exists(ttrace):
+        print('HotSpot failed for config%d (%s)' % (i, spotfiles.Label(point)), file=sys.stderr)
+        continue
+    with open(ttrace, 'r') as fd:
+        blocks, temps = spotfiles.ReadPtrace(fd)
+    temps = np.array(temps)
+    results.append((i, point, blocks, temps.max(axis=0), temps.mean(axis=0)))
+if not results:
+    sys.exit(1)
+
+print('%8s %10s %10s %-16s  %s' % ('config', 'peak (K)', 'mean (K)', 'hottest', 'parameters'))
+for i, point, blocks, peak, mean in sorted(results, key=lambda r: r[3].max()):
+    print('%8s %10.2f %10.2f %-16s  %s' % ('config%d' % i, peak.max(), mean.mean(), blocks[peak.argmax()], spotfiles.Label(point)))
+print('')
+print('%-24s' % 'peak/mean (K)' + ''.join('%16s' % ('config%d' % r[0]) for r in results))
+for j, block in enumerate(results[0][2]):
+    print('%-24s' % block + ''.join('%16s' % ('%.2f/%.2f' % (r[3][j], r[4][j])) for r in results))
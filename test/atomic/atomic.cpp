@@ -0,0 +1,241 @@
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <pthread.h>
+#include "../isa/rv32_64a.hpp"
+
+// Multi-core atomic contention benchmark.  Run under config/run.py with -n equal to
+// the thread count so that every thread gets its own core:
+//     atomic <threads> <iterations> [counter|ticket|queue|all]
+// Each test prints one "result:" line that src/atomicscale.py picks up.
+
+constexpr int MAX_THREADS = 64;
+constexpr int QUEUE_SLOTS = 64;
+
+struct alignas(64) Line
+{
+    volatile int64_t value;
+};
+
+struct Slot
+{
+    volatile int64_t sequence;
+    volatile int64_t data;
+};
+
+static int threads = 1;
+static int64_t iterations = 1000;
+
+static Line barrier_count;
+static Line barrier_phase;
+
+static Line counter;
+
+static Line next_ticket;
+static Line now_serving;
+static Line protected_count;
+
+static Line queue_head;
+static Line queue_tail;
+static Slot queue_slots[QUEUE_SLOTS];
+static Line queue_sum;
+
+static uint64_t cycles[MAX_THREADS];
+
+static inline uint64_t rdcycle()
+{
+    uint64_t c = 0;
+    asm volatile("rdcycle %0" : "=r" (c));
+    return c;
+}
+
+// Sense-reversing spin barrier built on AMOs so no thread enters the kernel while waiting
+static void barrier()
+{
+    using namespace rv32_64a::shared;
+
+    int64_t phase = load_d(&barrier_phase.value);
+    if (amoadd_d(&barrier_count.value, 1) == threads - 1)
+    {
+        store_d(&barrier_count.value, 0);
+        store_d(&barrier_phase.value, phase + 1);
+    }
+    else
+    {
+        while (load_d(&barrier_phase.value) == phase)
+            ;
+    }
+}
+
+// Shared counter: every thread hammers the same line with amoadd.d
+static void counter_test()
+{
+    for (int64_t i = 0; i < iterations; i++)
+        rv32_64a::shared::amoadd_d(&counter.value, 1);
+}
+
+// Ticket lock: amoadd.d to take a ticket, spin on the serving line, plain store to release
+static void ticket_test()
+{
+    using namespace rv32_64a::shared;
+
+    for (int64_t i = 0; i < iterations; i++)
+    {
+        int64_t ticket = amoadd_d(&next_ticket.value, 1);
+        while (load_d(&now_serving.value) != ticket)
+            ;
+        protected_count.value = protected_count.value + 1;
+        store_d(&now_serving.value, ticket + 1);
+    }
+}
+
+// Bounded MPMC ring (Vyukov) whose head/tail are claimed with LR/SC compare-and-swap loops.
+// Each thread enqueues a token and immediately dequeues one, so the queue never blocks.
+static bool enqueue(int64_t data)
+{
+    using namespace rv32_64a::shared;
+
+    for (;;)
+    {
+        int64_t pos = load_d(&queue_tail.value);
+        Slot& slot = queue_slots[pos%QUEUE_SLOTS];
+        int64_t diff = load_d(&slot.sequence) - pos;
+        if (diff == 0)
+        {
+            if (cas_d(&queue_tail.value, pos, pos + 1) == pos)
+            {
+                slot.data = data;
+                store_d(&slot.sequence, pos + 1);
+                return true;
+            }
+        }
+        else if (diff < 0)
+            return false;
+    }
+}
+
+static bool dequeue(int64_t& data)
+{
+    using namespace rv32_64a::shared;
+
+    for (;;)
+    {
+        int64_t pos = load_d(&queue_head.value);
+        Slot& slot = queue_slots[pos%QUEUE_SLOTS];
+        int64_t diff = load_d(&slot.sequence) - (pos + 1);
+        if (diff == 0)
+        {
+            if (cas_d(&queue_head.value, pos, pos + 1) == pos)
+            {
+                data = slot.data;
+                store_d(&slot.sequence, pos + QUEUE_SLOTS);
+                return true;
+            }
+        }
+        else if (diff < 0)
+            return false;
+    }
+}
+
+static void queue_test()
+{
+    int64_t sum = 0;
+    for (int64_t i = 0; i < iterations; i++)
+    {
+        int64_t data = 0;
+        while (!enqueue(i + 1))
+            ;
+        while (!dequeue(data))
+            ;
+        sum += data;
+    }
+    rv32_64a::shared::amoadd_d(&queue_sum.value, sum);
+}
+
+static void (*current_test)() = nullptr;
+
+static void* worker(void* arg)
+{
+    int id = (int)(intptr_t)arg;
+    barrier();
+    uint64_t start = rdcycle();
+    current_test();
+    cycles[id] = rdcycle() - start;
+    barrier();
+    return nullptr;
+}
+
+static bool run(const std::string& name, void (*test)(), int64_t ops_per_iteration)
+{
+    using namespace std;
+
+    current_test = test;
+    pthread_t tids[MAX_THREADS];
+    for (int i = 1; i < threads; i++)
+        pthread_create(&tids[i], nullptr, worker, (void*)(intptr_t)i);
+    worker((void*)0);
+    for (int i = 1; i < threads; i++)
+        pthread_join(tids[i], nullptr);
+
+    uint64_t max_cycles = 0;
+    for (int i = 0; i < threads; i++)
+        if (cycles[i] > max_cycles)
+            max_cycles = cycles[i];
+    int64_t ops = threads*iterations*ops_per_iteration;
+    cout << "result: test=" << name << " threads=" << threads << " ops=" << ops << " cycles=" << max_cycles
+         << " ops_per_kcycle=" << (max_cycles ? 1000.0*ops/max_cycles : 0.0) << endl;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+
+    if (argc < 3)
+    {
+        cout << "Usage: " << argv[0] << " <threads> <iterations> [counter|ticket|queue|all]" << endl;
+        return 1;
+    }
+    threads = atoi(argv[1]);
+    iterations = atoll(argv[2]);
+    string test = argc > 3 ? string(argv[3]) : string("all");
+    if (threads < 1 || threads > MAX_THREADS)
+    {
+        cout << "Thread count must be between 1 and " << MAX_THREADS << endl;
+        return 1;
+    }
+    for (int i = 0; i < QUEUE_SLOTS; i++)
+        queue_slots[i].sequence = i;
+
+    int failures = 0;
+    if (test == "counter" || test == "all")
+    {
+        run("counter", counter_test, 1);
+        if (counter.value != threads*iterations)
+        {
+            cout << "\033[1;31mFAIL\033[0m counter (expected " << threads*iterations << "; found " << counter.value << ")" << endl;
+            failures++;
+        }
+    }
+    if (test == "ticket" || test == "all")
+    {
+        run("ticket", ticket_test, 2);
+        if (protected_count.value != threads*iterations)
+        {
+            cout << "\033[1;31mFAIL\033[0m ticket (expected " << threads*iterations << "; found " << protected_count.value << ")" << endl;
+            failures++;
+        }
+    }
+    if (test == "queue" || test == "all")
+    {
+        run("queue", queue_test, 2);
+        int64_t expected = threads*(iterations*(iterations + 1)/2);
+        if (queue_sum.value != expected)
+        {
+            cout << "\033[1;31mFAIL\033[0m queue (expected " << expected << "; found " << queue_sum.value << ")" << endl;
+            failures++;
+        }
+    }
+    return failures;
+}
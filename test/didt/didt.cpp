@@ -0,0 +1,67 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include "../isa/rv32_64d.hpp"
+
+// di/dt stress kernel: alternates a burst of independent fmadd.d chains (high current)
+// with a spin on the cycle counter (low current) so the supply sees a square wave of
+// load current.  src/didt.py compiles one binary per period with -DPERIOD_CYCLES=...;
+// the command line can still override everything:
+//     didt [period_cycles] [duty_percent] [periods]
+
+#ifndef PERIOD_CYCLES
+#define PERIOD_CYCLES 1000
+#endif
+#ifndef DUTY_PERCENT
+#define DUTY_PERCENT 50
+#endif
+#ifndef PERIODS
+#define PERIODS 1000
+#endif
+
+static inline uint64_t rdcycle()
+{
+    uint64_t c = 0;
+    asm volatile("rdcycle %0" : "=r" (c));
+    return c;
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+
+    uint64_t period = argc > 1 ? strtoull(argv[1], nullptr, 0) : PERIOD_CYCLES;
+    uint64_t duty = argc > 2 ? strtoull(argv[2], nullptr, 0) : DUTY_PERCENT;
+    uint64_t periods = argc > 3 ? strtoull(argv[3], nullptr, 0) : PERIODS;
+    uint64_t high = period*duty/100;
+
+    // Eight independent accumulators keep every FMA pipeline slot busy
+    double a0 = 1.0, a1 = 1.0, a2 = 1.0, a3 = 1.0, a4 = 1.0, a5 = 1.0, a6 = 1.0, a7 = 1.0;
+    const double m = 0.9999999;
+    const double c = 1e-7;
+
+    uint64_t next = rdcycle();
+    for (uint64_t p = 0; p < periods; p++)
+    {
+        uint64_t edge = next + high;
+        next += period;
+        while (rdcycle() < edge)
+        {
+            FR4OP("fmadd.d", a0, a0, m, c);
+            FR4OP("fmadd.d", a1, a1, m, c);
+            FR4OP("fmadd.d", a2, a2, m, c);
+            FR4OP("fmadd.d", a3, a3, m, c);
+            FR4OP("fmadd.d", a4, a4, m, c);
+            FR4OP("fmadd.d", a5, a5, m, c);
+            FR4OP("fmadd.d", a6, a6, m, c);
+            FR4OP("fmadd.d", a7, a7, m, c);
+        }
+        while (rdcycle() < next)
+            ;
+    }
+
+    // Keep the accumulators live so the FMAs aren't optimized away
+    cout << "didt: period=" << period << " duty=" << duty << " periods=" << periods
+         << " checksum=" << a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7 << endl;
+    return 0;
+}
@@ -275,7 +275,8 @@ int main(int argc, char* argv[])
     {
         // RV32A extension
         // TODO: Test that these are actually atomic (add aq and rl instruction extensions)
-        // TODO: LR.W, SC.W
+        expect<tuple<int64_t, int64_t, uint64_t>>(make_tuple(65535, 255, 0), []{return rv32_64a::lr_sc_w(255, 65535);}, "lr.w/sc.w"); // LR.W, SC.W
+        expect<tuple<int64_t, int64_t, uint64_t>>(make_tuple(0x0000000180000000LL, -1, 0), []{return rv32_64a::lr_sc_w(0x00000001FFFFFFFFLL, 0x7FFFFFFF80000000LL);}, "lr.w/sc.w, sign extend/truncate"); // LR.W, SC.W
         expect<pair<int64_t, int64_t>>({65535, 255}, []{return rv32_64a::amoswap_w(255, 65535);}, "amoswap.w"); // AMOSWAP.W
         expect<pair<int64_t, int64_t>>({0xFFFFFFFF, -1}, []{return rv32_64a::amoswap_w(0xFFFFFFFF, 0xFFFFFFFF);}, "amoswap.w, sign extend"); // AMOSWAP.W
         expect<pair<int64_t, int64_t>>({0x0000000180000000LL, -1}, []{return rv32_64a::amoswap_w(0x00000001FFFFFFFFLL, 0x7FFFFFFF80000000LL);}, "amoswap.w, truncate"); // AMOSWAP.W
@@ -300,7 +301,7 @@ int main(int argc, char* argv[])
         if (size > 32)
         {
             // RV64A extension
-            // TODO: LR.D, SC.D
+            expect<tuple<int64_t, int64_t, uint64_t>>(make_tuple(1, -1, 0), []{return rv32_64a::lr_sc_d(-1, 1);}, "lr.d/sc.d"); // LR.D, SC.D
             expect<pair<int64_t, int64_t>>({1, -1}, []{return rv32_64a::amoswap_d(-1, 1);}, "amoswap.d"); // AMOSWAP.D
             expect<pair<int64_t, int64_t>>({0x7000000000000000LL, 0x0FFFFFFFFFFFFFFFLL}, []{return rv32_64a::amoadd_d(0x0FFFFFFFFFFFFFFFLL, 0x6000000000000001LL);}, "amoadd.d"); // AMOADD.D
             expect<pair<int64_t, int64_t>>({0, 0x7FFFFFFFFFFFFFFFLL}, []{return rv32_64a::amoadd_d(0x7FFFFFFFFFFFFFFFLL, 0x8000000000000001LL);}, "amoadd.d, overflow"); // AMOADD.D
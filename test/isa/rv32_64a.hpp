@@ -4,6 +4,17 @@
 
 namespace rv32_64a
 {
+    inline std::tuple<int64_t, int64_t, uint64_t> lr_sc_w(int64_t mem, int64_t rs2)
+    {
+        int64_t rd = 0;
+        uint64_t sc = -1;
+        uint64_t addr = (uint64_t)&mem;
+        asm volatile("lr.w %0,(%2);"
+                     "sc.w %1,%3,(%2)"
+                     : "=&r" (rd), "=&r" (sc) : "r" (addr), "r" (rs2) : "memory");
+        return std::tuple<int64_t, int64_t, uint64_t>(mem, rd, sc);
+    }
+
     inline std::pair<int64_t, int64_t> amoswap_w(int64_t mem, int64_t rs2)
     {
         int64_t rd = 0;
@@ -76,6 +87,17 @@ namespace rv32_64a
         return {mem, rd};
     }
 
+    inline std::tuple<int64_t, int64_t, uint64_t> lr_sc_d(int64_t mem, int64_t rs2)
+    {
+        int64_t rd = 0;
+        uint64_t sc = -1;
+        uint64_t addr = (uint64_t)&mem;
+        asm volatile("lr.d %0,(%2);"
+                     "sc.d %1,%3,(%2)"
+                     : "=&r" (rd), "=&r" (sc) : "r" (addr), "r" (rs2) : "memory");
+        return std::tuple<int64_t, int64_t, uint64_t>(mem, rd, sc);
+    }
+
     inline std::pair<int64_t, int64_t> amoswap_d(int64_t mem, int64_t rs2)
     {
         int64_t rd = 0;
@@ -147,4 +169,68 @@ namespace rv32_64a
         asm("amomaxu.d %0,%2,(%1)" : "=r" (rd) : "r" (addr), "r" (rs2) : "memory");
         return {mem, rd};
     }
+
+    // In-place variants for memory shared between harts; each returns the old value
+    // (sc_* return 0 on success, like the instruction)
+    namespace shared
+    {
+        inline int64_t amoswap_d(volatile int64_t* addr, int64_t rs2)
+        {
+            int64_t rd = 0;
+            asm volatile("amoswap.d.aqrl %0,%2,(%1)" : "=r" (rd) : "r" (addr), "r" (rs2) : "memory");
+            return rd;
+        }
+
+        inline int64_t amoadd_d(volatile int64_t* addr, int64_t rs2)
+        {
+            int64_t rd = 0;
+            asm volatile("amoadd.d.aqrl %0,%2,(%1)" : "=r" (rd) : "r" (addr), "r" (rs2) : "memory");
+            return rd;
+        }
+
+        inline int64_t load_d(volatile int64_t* addr)
+        {
+            int64_t rd = 0;
+            asm volatile("ld %0,0(%1);"
+                         "fence r,rw"
+                         : "=r" (rd) : "r" (addr) : "memory");
+            return rd;
+        }
+
+        inline void store_d(volatile int64_t* addr, int64_t rs2)
+        {
+            asm volatile("fence rw,w;"
+                         "sd %1,0(%0)"
+                         : : "r" (addr), "r" (rs2) : "memory");
+        }
+
+        inline int64_t lr_d(volatile int64_t* addr)
+        {
+            int64_t rd = 0;
+            asm volatile("lr.d.aq %0,(%1)" : "=r" (rd) : "r" (addr) : "memory");
+            return rd;
+        }
+
+        inline uint64_t sc_d(volatile int64_t* addr, int64_t rs2)
+        {
+            uint64_t rd = -1;
+            asm volatile("sc.d.rl %0,%2,(%1)" : "=r" (rd) : "r" (addr), "r" (rs2) : "memory");
+            return rd;
+        }
+
+        // Compare-and-swap as one constrained LR/SC loop, so nothing the compiler emits can land
+        // between the reservation and the store; returns the value found at addr
+        inline int64_t cas_d(volatile int64_t* addr, int64_t expected, int64_t desired)
+        {
+            int64_t found = 0;
+            uint64_t failed = 0;
+            asm volatile("1: lr.d.aq %0,(%2);"
+                         "bne %0,%3,2f;"
+                         "sc.d.rl %1,%4,(%2);"
+                         "bnez %1,1b;"
+                         "2:"
+                         : "=&r" (found), "=&r" (failed) : "r" (addr), "r" (expected), "r" (desired) : "memory");
+            return found;
+        }
+    }
 }